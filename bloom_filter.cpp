@@ -0,0 +1,45 @@
+#include "bloom_filter.h"
+
+// 64-bit FNV-1a. Saved filters depend on this, so it must never change.
+static uint64_t hash_string(std::string_view str) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (unsigned char c : str) {
+		h ^= c;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+bloom_filter::bloom_filter(size_t items) : m_words((items * BITS_PER_ITEM + 63) / 64 + 1) {}
+
+void bloom_filter::add(std::string_view str) {
+	if (m_words.empty()) {
+		return;
+	}
+
+	// Derive every probe from one hash (Kirsch-Mitzenmacher double hashing)
+	uint64_t h = hash_string(str);
+	uint64_t step = (h >> 33) | 1;
+	uint64_t bits = m_words.size() * 64;
+	for (uint32_t i = 0; i < m_hashes; ++i, h += step) {
+		uint64_t bit = h % bits;
+		m_words[bit / 64] |= 1ull << (bit % 64);
+	}
+}
+
+bool bloom_filter::may_contain(std::string_view str) const {
+	if (m_words.empty()) {
+		return true;
+	}
+
+	uint64_t h = hash_string(str);
+	uint64_t step = (h >> 33) | 1;
+	uint64_t bits = m_words.size() * 64;
+	for (uint32_t i = 0; i < m_hashes; ++i, h += step) {
+		uint64_t bit = h % bits;
+		if (!(m_words[bit / 64] & (1ull << (bit % 64)))) {
+			return false;
+		}
+	}
+	return true;
+}
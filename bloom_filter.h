@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/**
+ * A Bloom filter over strings.
+ *
+ * may_contain() never says no for a string that was added, and says yes for a string
+ * that wasn't with a probability of roughly 1% at the default size. The hash is fixed,
+ * so a filter's bits can be saved and loaded again by a later run.
+ */
+class bloom_filter {
+public:
+	/** Bits set aside per expected item; with HASHES probes this gives about 1% false positives */
+	static constexpr size_t BITS_PER_ITEM = 10;
+	static constexpr uint32_t HASHES = 7;
+	/** Most probes a saved filter may ask for; anything more is corrupt, and slow to check */
+	static constexpr uint32_t MAX_HASHES = 32;
+
+	bloom_filter() {}
+
+	/**
+	 * Make an empty filter sized for the given number of items.
+	 */
+	explicit bloom_filter(size_t items);
+
+	/**
+	 * Make a filter from the bits of a saved one.
+	 */
+	bloom_filter(std::span<const uint64_t> words, uint32_t hashes)
+		: m_words(words.begin(), words.end()), m_hashes(hashes) {}
+
+	void add(std::string_view str);
+
+	/**
+	 * Check whether a string may have been added. An empty filter (one that was never
+	 * sized) says yes to everything, since it knows nothing.
+	 */
+	bool may_contain(std::string_view str) const;
+
+	bool empty() const { return m_words.empty(); }
+	const std::vector<uint64_t>& words() const { return m_words; }
+	uint32_t hashes() const { return m_hashes; }
+
+private:
+	std::vector<uint64_t> m_words;
+	uint32_t m_hashes = HASHES;
+};
@@ -0,0 +1,44 @@
+#include "bloom_filter.h"
+
+#include <string>
+#include <gtest/gtest.h>
+
+TEST(bloom_filter, no_false_negatives) {
+	bloom_filter filter(1000);
+	for (int i = 0; i < 1000; ++i) {
+		filter.add("dir/file" + std::to_string(i) + ".txt");
+	}
+
+	for (int i = 0; i < 1000; ++i) {
+		ASSERT_TRUE(filter.may_contain("dir/file" + std::to_string(i) + ".txt"));
+	}
+}
+
+TEST(bloom_filter, few_false_positives) {
+	bloom_filter filter(1000);
+	for (int i = 0; i < 1000; ++i) {
+		filter.add("dir/file" + std::to_string(i) + ".txt");
+	}
+
+	int hits = 0;
+	for (int i = 0; i < 10000; ++i) {
+		hits += filter.may_contain("other/file" + std::to_string(i) + ".txt");
+	}
+	// About 1% is expected; allow plenty of slack
+	ASSERT_LT(hits, 300);
+}
+
+TEST(bloom_filter, empty_knows_nothing) {
+	bloom_filter filter;
+	ASSERT_TRUE(filter.empty());
+	ASSERT_TRUE(filter.may_contain("anything"));
+}
+
+TEST(bloom_filter, saved_bits) {
+	bloom_filter filter(10);
+	filter.add("models/ship.mdl");
+
+	bloom_filter loaded(filter.words(), filter.hashes());
+	ASSERT_TRUE(loaded.may_contain("models/ship.mdl"));
+	ASSERT_EQ(filter.may_contain("ship.mdl"), loaded.may_contain("ship.mdl"));
+}
@@ -1,8 +1,10 @@
 #include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 #include <string>
 #include <list>
+#include <vector>
 
 #include "datadir.h"
 #include "datafile.h"
@@ -129,18 +131,39 @@ bool unpack_file(const std::filesystem::path& inpath, const std::filesystem::pat
 	return true;
 }
 
-bool extract_archive(const datafile& idx, const std::filesystem::path& outpath) {
-	return idx.extract(outpath);
+bool extract_archive(const datafile& idx, const std::filesystem::path& outpath, unsigned jobs) {
+	return idx.extract(outpath, jobs);
 }
 
-bool extract_all(const std::string& inpath, const std::filesystem::path& outpath, bool unpack_pck) {
+bool extract_all(const std::string& inpath,
+                 const std::filesystem::path& outpath,
+                 bool unpack_pck,
+                 bool use_mmap,
+                 size_t buffer_size,
+                 bool use_cache,
+                 bool use_io_uring,
+                 bool drop_cache,
+                 unsigned jobs) {
 	// Create the target directory if it doesn't exist
 	std::filesystem::create_directories(outpath);
 
 	// Now extract the catalogs in the directory to the target path
 	datadir dd(inpath);
+	if (use_cache) {
+		dd.use_cache(std::filesystem::path(inpath) / datadir::CACHE_FILENAME);
+	}
 	dd.unpack_on_extract(unpack_pck);
-	return dd.extract(outpath);
+	if (use_mmap) {
+		dd.map_datfiles(ACCESS_SEQUENTIAL);
+	}
+	if (buffer_size) {
+		dd.set_buffer_size(buffer_size);
+	}
+	dd.use_io_uring(use_io_uring);
+	dd.drop_cache_after_extract(drop_cache);
+	bool ret = dd.extract(outpath, jobs);
+	dd.save_cache();
+	return ret;
 }
 
 bool build_package(const std::filesystem::path& cat_filename, const std::filesystem::path& src_path) {
@@ -155,39 +178,208 @@ bool build_package(const std::filesystem::path& cat_filename, const std::filesys
 	return idx.build(p, cat_filename);
 }
 
-bool search(const std::filesystem::path& inpath, const std::filesystem::path& needle) {
+bool search(const std::filesystem::path& inpath,
+            const std::filesystem::path& needle,
+            bool use_cache,
+            bool ignore_case,
+            bool show_overrides) {
 	datadir search_dir(inpath.string());
+	search_dir.ignore_case(ignore_case);
+	if (use_cache) {
+		search_dir.use_cache(inpath / datadir::CACHE_FILENAME);
+	}
+	if (show_overrides) {
+		// find() stops at the first catalog that settles the answer, so the older versions
+		// are only all known once every catalog has been read
+		search_dir.load_all();
+	}
 
-	datafile* ret = search_dir.search(needle.string(), false);
+	const datadir::overlay_entry* ret = search_dir.find(needle.string(), false);
+	search_dir.save_cache();
 
 	if (ret) {
-		std::cout << "The file " << needle << " is most recently found in " << ret->get_catfile_name() << "\n";
+		std::cout << "The file " << needle << " is most recently found in " << ret->file->get_catfile_name() << "\n";
+		for (const auto* older = ret->shadowed; show_overrides && older; older = older->shadowed) {
+			std::cout << "  It overrides the version of " << ret->entry->relpath << " in "
+			          << older->file->get_catfile_name() << "\n";
+		}
 		return true;
 	}
 	std::cout << "The file " << needle << " was not found in any catalog in " << inpath << "\n";
 	return true; // Still technically a successful operation
 }
 
+// Print every file whose path matches the pattern, one tab-separated line each:
+// the path, the winning .cat file and the size
+bool search_pattern(const std::filesystem::path& inpath,
+                    const std::string& pattern,
+                    bool regex,
+                    bool use_cache,
+                    bool ignore_case) {
+	datadir search_dir(inpath.string());
+	search_dir.ignore_case(ignore_case);
+	if (use_cache) {
+		search_dir.use_cache(inpath / datadir::CACHE_FILENAME);
+	}
+
+	std::vector<const datadir::overlay_entry*> results;
+	bool ret = search_dir.match(pattern, regex, results);
+	search_dir.save_cache();
+
+	std::string out;
+	for (const datadir::overlay_entry* result : results) {
+		out += result->entry->relpath;
+		out += '\t';
+		out += result->file->get_catfile_name();
+		out += '\t';
+		out += std::to_string(result->entry->size);
+		out += '\n';
+	}
+	std::cout << out << std::flush;
+	return ret;
+}
+
+// Most names a batch search looks up at once
+static constexpr size_t BATCH_CHUNK = 4096;
+
+// Read the next names of a batch, skipping blank lines. This waits for one name and then
+// only takes the ones that have already arrived, so a caller that sends a name and waits
+// for the answer gets it straight away. Returns false at the end of the batch.
+static bool read_batch_chunk(std::istream& in, std::vector<std::string>& names) {
+	names.clear();
+	std::string line;
+	while (names.size() < BATCH_CHUNK && (names.empty() || in.rdbuf()->in_avail() > 0) && std::getline(in, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			names.push_back(std::move(line));
+		}
+	}
+	return !names.empty();
+}
+
+// Search for every name listed in the batch file, one per line, and print one tab-separated
+// line per name: the name, then the winning .cat file and the size, or - - if nothing has it.
+// Names are answered in the order they came in, a chunk at a time as they arrive.
+bool search_batch(const std::filesystem::path& inpath,
+                  const std::filesystem::path& batch_file,
+                  bool use_cache,
+                  bool ignore_case,
+                  unsigned jobs) {
+	std::ifstream batch_stream;
+	if (batch_file != "-") {
+		batch_stream.open(batch_file);
+		if (!batch_stream) {
+			std::cerr << "Could not open batch file " << batch_file << " for reading\n";
+			return false;
+		}
+	} else {
+		// When synced with stdio, std::cin can't tell how much input is waiting
+		std::ios::sync_with_stdio(false);
+	}
+	std::istream& in = batch_file == "-" ? std::cin : batch_stream;
+
+	datadir search_dir(inpath.string(), jobs);
+	search_dir.ignore_case(ignore_case);
+	if (use_cache) {
+		search_dir.use_cache(inpath / datadir::CACHE_FILENAME);
+	}
+
+	std::vector<std::string> names;
+	while (read_batch_chunk(in, names)) {
+		auto results = search_dir.find_all(names, false);
+		// Only writes anything the first time round, once every catalog has been loaded
+		search_dir.save_cache();
+
+		std::string out;
+		for (size_t i = 0; i < names.size(); ++i) {
+			out += names[i];
+			if (results[i]) {
+				out += '\t';
+				out += results[i]->file->get_catfile_name();
+				out += '\t';
+				out += std::to_string(results[i]->entry->size);
+				out += '\n';
+			} else {
+				out += "\t-\t-\n";
+			}
+		}
+		std::cout << out << std::flush;
+	}
+	return true;
+}
+
+bool list_dir(const std::filesystem::path& inpath, const std::string& dir, bool use_cache, bool ignore_case) {
+	datadir search_dir(inpath.string());
+	search_dir.ignore_case(ignore_case);
+	if (use_cache) {
+		search_dir.use_cache(inpath / datadir::CACHE_FILENAME);
+	}
+
+	std::vector<datadir::dir_entry> entries;
+	bool found = search_dir.list(dir, entries);
+	search_dir.save_cache();
+
+	if (!found) {
+		std::cerr << "There is no directory " << dir << " in any catalog in " << inpath << "\n";
+		return false;
+	}
+
+	for (const auto& entry : entries) {
+		if (entry.file) {
+			std::cout << std::setw(48) << std::left << entry.name << std::setw(12) << std::right
+			          << entry.file->entry->size << "  "
+			          << std::filesystem::path(entry.file->file->get_catfile_name()).filename().string() << "\n";
+		} else {
+			std::cout << entry.name << "/\n";
+		}
+	}
+	return true;
+}
+
 static void usage() {
 	std::cout
 		<< "Usage: x3tool <operation> [cat_file] [options]\n"
 		<< "  Valid operations: t / dump-index             Print the index of the package file\n"
 		<< "                    d / decode-file  [-o output-path]  Decode cat file to the given "
 		   "path (or current directory)\n"
-		<< "                    f / extract-file <-f filename> [--pck] [-o output-file]  Extract the "
-		   "contents of a single file to disk\n"
-		<< "                    x / extract-archive  [--pck] [-o output-path]  Extract one entire archive "
-		   "to the output path (or current directory)\n"
+		<< "                    f / extract-file <-f filename> [--pck] [--mmap] [--ignore-case] [-o output-file]  "
+		   "Extract the contents of a single file to disk\n"
+		<< "                    x / extract-archive  [--pck] [--mmap] [--io-uring] [--drop-cache] [-j jobs] "
+		   "[-o output-path]  Extract one entire archive to the output path (or current directory)\n"
 		<< "                    p / build-package <-i input-path>  Build a new cat file with the "
 		   "contents of input-path\n"
-		<< "                    a / extract-all <-i input-path> [--pck] <-o output-path>  Extract every archive in the "
-		   "provided directory to the output path\n"
-		<< "                    s / search <-f filename>  <-i search-directory> Find the most recent "
-		<< "cat file in the provided directory which contains the given file\n"
+		<< "                    a / extract-all <-i input-path> [--pck] [--mmap] [--cache] [--io-uring] [--drop-cache] "
+		   "[-j jobs] <-o output-path>  Extract every archive in the provided directory to the output path\n"
+		<< "                    s / search <-f filename>  <-i search-directory> [--cache] [--ignore-case] "
+		   "[--overrides]  Find the most recent cat file in the provided directory which contains the given file\n"
+		<< "                    s / search <-b batch-file> <-i search-directory> [--cache] [--ignore-case] [-j jobs]  "
+		   "Search for every name in batch-file (- for stdin), printing name, cat file and size separated by tabs\n"
+		<< "                    s / search <-f pattern> <-i search-directory> <--glob | --regex> [--cache] "
+		   "[--ignore-case]  Print every file whose path matches, with its cat file and size separated by tabs\n"
+		<< "                    l / ls <-i search-directory> [-f directory] [--cache] [--ignore-case]  List a "
+		   "directory across every cat file in the provided directory, with sizes and the cat file each file "
+		   "comes from\n"
 		<< "                    k / pack-file <-i input-file> [-o output.pck]  Compress a file to .pck format\n"
 		<< "                    u / unpack-file <-i input.pck> [-o output-file]  Decompress a .pck file\n"
 		<< "\n  Flags:\n"
-		<< "                    --pck                    Automatically decompress .pck files during extraction\n";
+		<< "                    --pck                    Automatically decompress .pck files during extraction\n"
+		<< "                    --mmap                   Memory-map .dat files instead of reading them\n"
+		<< "                    --io-uring               Extract through io_uring, if the kernel supports it\n"
+		<< "                    --drop-cache             Keep extracted data out of the page cache (waits for each "
+		   "file to hit the disk)\n"
+		<< "                    --overrides              For search, also list the older versions the file overrides\n"
+		<< "                    --glob                   Treat the search filename as a glob (*, ?, [abc], and ** "
+		   "for any directories)\n"
+		<< "                    --regex                  Treat the search filename as a regular expression "
+		   "matching the whole path\n"
+		<< "                    --ignore-case            Match paths like the game does, ignoring case and \\ vs /\n"
+		<< "                    --cache                  Keep the catalog indexes of the directory in "
+		<< datadir::CACHE_FILENAME << "\n"
+		<< "                    -j / --jobs <n>          Number of threads to extract or search with\n"
+		<< "                    --buffer-size <size>     Stream extracted files in blocks of this size (e.g. 64K, "
+		   "4M)\n";
 }
 
 int main(int argc, char** argv) {
@@ -200,15 +392,46 @@ int main(int argc, char** argv) {
 		return -1;
 	}
 
-	// search, build_package, extract_all, pack_file, and unpack_file operations do not need an input catalog file
+	// search, ls, build_package, extract_all, pack_file, and unpack_file operations do not need an input catalog file
 	bool done = false;
 	switch (op.get_type()) {
 	case SEARCH:
-		ret = search(op.get_src_filename(), op.get_internal_filename());
+		if (!op.get_batch_filename().empty()) {
+			ret = search_batch(op.get_src_filename(),
+			                   op.get_batch_filename(),
+			                   op.get_cache_flag(),
+			                   op.get_ignore_case_flag(),
+			                   op.get_jobs());
+		} else if (op.get_glob_flag() || op.get_regex_flag()) {
+			ret = search_pattern(op.get_src_filename(),
+			                     op.get_internal_filename(),
+			                     op.get_regex_flag(),
+			                     op.get_cache_flag(),
+			                     op.get_ignore_case_flag());
+		} else {
+			ret = search(op.get_src_filename(),
+			             op.get_internal_filename(),
+			             op.get_cache_flag(),
+			             op.get_ignore_case_flag(),
+			             op.get_overrides_flag());
+		}
+		done = true;
+		break;
+	case LIST_DIR:
+		ret = list_dir(
+			op.get_src_filename(), op.get_internal_filename(), op.get_cache_flag(), op.get_ignore_case_flag());
 		done = true;
 		break;
 	case EXTRACT_ALL:
-		ret = extract_all(op.get_src_filename(), op.get_dest_path(), op.get_pck_flag());
+		ret = extract_all(op.get_src_filename(),
+		                  op.get_dest_path(),
+		                  op.get_pck_flag(),
+		                  op.get_mmap_flag(),
+		                  op.get_buffer_size(),
+		                  op.get_cache_flag(),
+		                  op.get_io_uring_flag(),
+		                  op.get_drop_cache_flag(),
+		                  op.get_jobs());
 		done = true;
 		break;
 	case BUILD_PACKAGE: {
@@ -264,6 +487,27 @@ int main(int argc, char** argv) {
 			df.unpack_on_extract(true);
 		}
 
+		if (op.get_buffer_size()) {
+			df.set_buffer_size(op.get_buffer_size());
+		}
+
+		if (op.get_ignore_case_flag()) {
+			df.set_ignore_case(true);
+		}
+
+		if (op.get_io_uring_flag()) {
+			df.use_io_uring(true);
+		}
+
+		if (op.get_drop_cache_flag()) {
+			df.drop_cache_after_extract(true);
+		}
+
+		// Map the .dat file if --mmap is set; a whole archive is read front to back, single files are not
+		if (op.get_mmap_flag()) {
+			df.map_datfile(op.get_type() == EXTRACT_ARCHIVE ? ACCESS_SEQUENTIAL : ACCESS_RANDOM);
+		}
+
 		switch (op.get_type()) {
 		case DUMP_INDEX:
 			ret = dump_index(df);
@@ -286,7 +530,7 @@ int main(int argc, char** argv) {
 			if (outpath.empty()) {
 				outpath = ".";
 			}
-			ret = extract_archive(df, outpath);
+			ret = extract_archive(df, outpath, op.get_jobs());
 		} break;
 		default:
 			return -1;
@@ -0,0 +1,87 @@
+#include "cipher.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Throughput benchmark for the cipher kernels.
+ *
+ * Runs every implementation the CPU supports over the same buffer, along with the
+ * byte-at-a-time loop the kernels replaced, and prints GB/s for each.
+ *
+ * Usage: xtbench [buffer-size-in-MB]
+ */
+
+constexpr int ITERATIONS = 20;
+
+template <typename F> static double measure(std::vector<uint8_t>& buffer, F&& fn) {
+	// Warm up the caches and page in the buffer
+	fn(buffer.data(), buffer.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITERATIONS; ++i) {
+		fn(buffer.data(), buffer.size());
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return (double)buffer.size() * ITERATIONS / elapsed.count() / 1e9;
+}
+
+static void report(const std::string& name, double gbps) {
+	std::cout << "  " << std::setw(24) << std::left << name << std::setw(8) << std::right << std::fixed
+	          << std::setprecision(2) << gbps << " GB/s\n";
+}
+
+// What datafile used to do for every byte of a .dat file
+__attribute__((noinline)) static void byte_loop(uint8_t* data, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		data[i] ^= 0x33;
+		asm volatile("" ::: "memory");
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t mb = 64;
+	if (argc > 1) {
+		mb = std::strtoul(argv[1], nullptr, 10);
+	}
+	if (mb == 0) {
+		std::cerr << "Usage: xtbench [buffer-size-in-MB]\n";
+		return 1;
+	}
+
+	std::vector<uint8_t> buffer(mb * 1024 * 1024);
+	for (size_t i = 0; i < buffer.size(); ++i) {
+		buffer[i] = (uint8_t)i;
+	}
+
+	std::cout << "Buffer: " << mb << " MB, " << ITERATIONS << " iterations, default backend: " << cipher_backend()
+	          << "\n\n.dat cipher (in place):\n";
+	report("byte loop", measure(buffer, byte_loop));
+
+	const char* backends[] = {"scalar", "sse2", "avx2", "avx512"};
+	for (const char* name : backends) {
+		if (!set_cipher_backend(name)) {
+			continue;
+		}
+		report(name, measure(buffer, [](uint8_t* data, size_t len) { dat_cipher(data, data, len); }));
+	}
+
+	std::cout << "\n.cat cipher (in place):\n";
+	for (const char* name : backends) {
+		if (!set_cipher_backend(name)) {
+			continue;
+		}
+		report(name, measure(buffer, [](uint8_t* data, size_t len) { cat_cipher(data, data, len); }));
+	}
+	set_cipher_backend("");
+	report("parallel (" + std::string(cipher_backend()) + ")",
+	       measure(buffer, [](uint8_t* data, size_t len) { cat_cipher_parallel(data, data, len); }));
+
+	return 0;
+}
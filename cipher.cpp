@@ -0,0 +1,226 @@
+#include "cipher.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CIPHER_X86 1
+#include <immintrin.h>
+#endif
+
+// Buffers smaller than this per thread are not worth handing to another thread
+constexpr size_t PARALLEL_CHUNK_SIZE = 4 * 1024 * 1024; // 4 MB
+
+// Widest vector the kernels load at once
+constexpr size_t MAX_VECTOR = 32;
+
+/**
+ * The .cat keystream, with the first MAX_VECTOR bytes repeated at the end so that a
+ * full vector can be loaded from any starting key without wrapping.
+ */
+static constexpr std::array<uint8_t, 256 + MAX_VECTOR> make_cat_keystream() {
+	std::array<uint8_t, 256 + MAX_VECTOR> ks{};
+	for (size_t i = 0; i < ks.size(); ++i) {
+		ks[i] = (uint8_t)(CAT_MAGIC + i);
+	}
+	return ks;
+}
+
+alignas(64) static constexpr std::array<uint8_t, 256 + MAX_VECTOR> cat_keystream = make_cat_keystream();
+
+static void dat_cipher_scalar(const uint8_t* src, uint8_t* dst, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		dst[i] = src[i] ^ DAT_MAGIC;
+	}
+}
+
+static void cat_cipher_scalar(const uint8_t* src, uint8_t* dst, size_t len, size_t pos) {
+	for (size_t i = 0; i < len; ++i) {
+		dst[i] = src[i] ^ cat_keystream[(pos + i) & 0xff];
+	}
+}
+
+#ifdef CIPHER_X86
+__attribute__((target("sse2"))) static void dat_cipher_sse2(const uint8_t* src, uint8_t* dst, size_t len) {
+	const __m128i key = _mm_set1_epi8((char)DAT_MAGIC);
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i data = _mm_loadu_si128((const __m128i*)&src[i]);
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(data, key));
+	}
+	dat_cipher_scalar(src + i, dst + i, len - i);
+}
+
+__attribute__((target("avx2"))) static void dat_cipher_avx2(const uint8_t* src, uint8_t* dst, size_t len) {
+	const __m256i key = _mm256_set1_epi8((char)DAT_MAGIC);
+	size_t i = 0;
+	for (; i + 128 <= len; i += 128) {
+		__m256i data0 = _mm256_loadu_si256((const __m256i*)&src[i]);
+		__m256i data1 = _mm256_loadu_si256((const __m256i*)&src[i + 32]);
+		__m256i data2 = _mm256_loadu_si256((const __m256i*)&src[i + 64]);
+		__m256i data3 = _mm256_loadu_si256((const __m256i*)&src[i + 96]);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(data0, key));
+		_mm256_storeu_si256((__m256i*)&dst[i + 32], _mm256_xor_si256(data1, key));
+		_mm256_storeu_si256((__m256i*)&dst[i + 64], _mm256_xor_si256(data2, key));
+		_mm256_storeu_si256((__m256i*)&dst[i + 96], _mm256_xor_si256(data3, key));
+	}
+	for (; i + 32 <= len; i += 32) {
+		__m256i data = _mm256_loadu_si256((const __m256i*)&src[i]);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(data, key));
+	}
+	dat_cipher_scalar(src + i, dst + i, len - i);
+}
+
+__attribute__((target("avx512f"))) static void dat_cipher_avx512(const uint8_t* src, uint8_t* dst, size_t len) {
+	const __m512i key = _mm512_set1_epi8((char)DAT_MAGIC);
+	size_t i = 0;
+	for (; i + 256 <= len; i += 256) {
+		__m512i data0 = _mm512_loadu_si512((const void*)&src[i]);
+		__m512i data1 = _mm512_loadu_si512((const void*)&src[i + 64]);
+		__m512i data2 = _mm512_loadu_si512((const void*)&src[i + 128]);
+		__m512i data3 = _mm512_loadu_si512((const void*)&src[i + 192]);
+		_mm512_storeu_si512((void*)&dst[i], _mm512_xor_si512(data0, key));
+		_mm512_storeu_si512((void*)&dst[i + 64], _mm512_xor_si512(data1, key));
+		_mm512_storeu_si512((void*)&dst[i + 128], _mm512_xor_si512(data2, key));
+		_mm512_storeu_si512((void*)&dst[i + 192], _mm512_xor_si512(data3, key));
+	}
+	for (; i + 64 <= len; i += 64) {
+		__m512i data = _mm512_loadu_si512((const void*)&src[i]);
+		_mm512_storeu_si512((void*)&dst[i], _mm512_xor_si512(data, key));
+	}
+	dat_cipher_scalar(src + i, dst + i, len - i);
+}
+
+__attribute__((target("sse2"))) static void cat_cipher_sse2(const uint8_t* src, uint8_t* dst, size_t len, size_t pos) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i key = _mm_loadu_si128((const __m128i*)&cat_keystream[(pos + i) & 0xff]);
+		__m128i data = _mm_loadu_si128((const __m128i*)&src[i]);
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(data, key));
+	}
+	cat_cipher_scalar(src + i, dst + i, len - i, pos + i);
+}
+
+__attribute__((target("avx2"))) static void cat_cipher_avx2(const uint8_t* src, uint8_t* dst, size_t len, size_t pos) {
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64) {
+		__m256i key0 = _mm256_loadu_si256((const __m256i*)&cat_keystream[(pos + i) & 0xff]);
+		__m256i key1 = _mm256_loadu_si256((const __m256i*)&cat_keystream[(pos + i + 32) & 0xff]);
+		__m256i data0 = _mm256_loadu_si256((const __m256i*)&src[i]);
+		__m256i data1 = _mm256_loadu_si256((const __m256i*)&src[i + 32]);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(data0, key0));
+		_mm256_storeu_si256((__m256i*)&dst[i + 32], _mm256_xor_si256(data1, key1));
+	}
+	for (; i + 32 <= len; i += 32) {
+		__m256i key = _mm256_loadu_si256((const __m256i*)&cat_keystream[(pos + i) & 0xff]);
+		__m256i data = _mm256_loadu_si256((const __m256i*)&src[i]);
+		_mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(data, key));
+	}
+	cat_cipher_scalar(src + i, dst + i, len - i, pos + i);
+}
+#endif
+
+using dat_kernel = void (*)(const uint8_t*, uint8_t*, size_t);
+using cat_kernel = void (*)(const uint8_t*, uint8_t*, size_t, size_t);
+
+struct cipher_kernels {
+	const char* name;
+	dat_kernel dat;
+	cat_kernel cat;
+};
+
+// Every implementation, widest first
+static const cipher_kernels all_kernels[] = {
+#ifdef CIPHER_X86
+	// The rolling key repeats every 256 bytes, so wider vectors than AVX2 don't buy the .cat cipher much
+	{"avx512", dat_cipher_avx512, cat_cipher_avx2},
+	{"avx2", dat_cipher_avx2, cat_cipher_avx2},
+	{"sse2", dat_cipher_sse2, cat_cipher_sse2},
+#endif
+	{"scalar", dat_cipher_scalar, cat_cipher_scalar},
+};
+
+static bool cpu_supports(const cipher_kernels& k) {
+#ifdef CIPHER_X86
+	__builtin_cpu_init();
+	if (strcmp(k.name, "avx512") == 0) {
+		return __builtin_cpu_supports("avx512f");
+	} else if (strcmp(k.name, "avx2") == 0) {
+		return __builtin_cpu_supports("avx2");
+	} else if (strcmp(k.name, "sse2") == 0) {
+		return __builtin_cpu_supports("sse2");
+	}
+#endif
+	return true;
+}
+
+static const cipher_kernels* select_kernels() {
+	for (const auto& k : all_kernels) {
+		if (cpu_supports(k)) {
+			return &k;
+		}
+	}
+	return &all_kernels[std::size(all_kernels) - 1];
+}
+
+static const cipher_kernels* active_kernels = nullptr;
+
+static const cipher_kernels& kernels() {
+	static const cipher_kernels* best = select_kernels();
+	return active_kernels ? *active_kernels : *best;
+}
+
+void dat_cipher(const uint8_t* src, uint8_t* dst, size_t len) {
+	kernels().dat(src, dst, len);
+}
+
+void cat_cipher(const uint8_t* src, uint8_t* dst, size_t len, size_t pos) {
+	kernels().cat(src, dst, len, pos);
+}
+
+void cat_cipher_parallel(const uint8_t* src, uint8_t* dst, size_t len, size_t pos) {
+	size_t nthreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), len / PARALLEL_CHUNK_SIZE);
+	if (nthreads <= 1) {
+		cat_cipher(src, dst, len, pos);
+		return;
+	}
+
+	// Each chunk carries its own offset, so the chunks are independent of each other
+	size_t chunk = (len + nthreads - 1) / nthreads;
+	std::vector<std::thread> workers;
+	for (size_t start = chunk; start < len; start += chunk) {
+		size_t n = std::min(chunk, len - start);
+		workers.emplace_back(cat_cipher, src + start, dst + start, n, pos + start);
+	}
+	cat_cipher(src, dst, std::min(chunk, len), pos);
+
+	for (auto& t : workers) {
+		t.join();
+	}
+}
+
+const char* cipher_backend() {
+	return kernels().name;
+}
+
+bool set_cipher_backend(const std::string& name) {
+	if (name.empty()) {
+		active_kernels = nullptr;
+		return true;
+	}
+
+	for (const auto& k : all_kernels) {
+		if (name == k.name) {
+			if (!cpu_supports(k)) {
+				return false;
+			}
+			active_kernels = &k;
+			return true;
+		}
+	}
+	return false;
+}
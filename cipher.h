@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * XOR ciphers used by X3 archives.
+ *
+ * .dat files are XORed with the constant byte 0x33.
+ *
+ * .cat files are XORed with a rolling key that starts at 0xdb and goes up by
+ * one (mod 256) for every byte. Since the key only depends on the position in
+ * the file, any chunk of a catalog can be processed on its own as long as its
+ * offset is known.
+ *
+ * The kernels pick the widest vector unit the CPU supports the first time
+ * they are used, and fall back to plain scalar code everywhere else.
+ */
+
+/** Key of every byte of a .dat file */
+constexpr uint8_t DAT_MAGIC = 0x33;
+
+/** Key of the first byte of a .cat file */
+constexpr uint8_t CAT_MAGIC = 0xdb;
+
+/**
+ * Apply the .dat cipher to a buffer. Encryption and decryption are the same operation.
+ *
+ * @param src Input bytes
+ * @param dst Output bytes; may be the same buffer as src
+ * @param len Number of bytes to process
+ */
+void dat_cipher(const uint8_t* src, uint8_t* dst, size_t len);
+
+/**
+ * Apply the .cat cipher to a buffer. Encryption and decryption are the same operation.
+ *
+ * @param src Input bytes
+ * @param dst Output bytes; may be the same buffer as src
+ * @param len Number of bytes to process
+ * @param pos Offset of src[0] within the catalog, which determines the key
+ */
+void cat_cipher(const uint8_t* src, uint8_t* dst, size_t len, size_t pos = 0);
+
+/**
+ * Same as cat_cipher, but large buffers are split into chunks that are processed on
+ * several threads. Small buffers are handled on the calling thread.
+ */
+void cat_cipher_parallel(const uint8_t* src, uint8_t* dst, size_t len, size_t pos = 0);
+
+/**
+ * Name of the implementation the kernels dispatch to ("scalar", "sse2", "avx2", "avx512").
+ */
+const char* cipher_backend();
+
+/**
+ * Force the kernels to use a particular implementation, for tests and benchmarks.
+ * An empty name goes back to the automatic choice.
+ *
+ * Returns false if the name is unknown or the CPU does not support it. Not safe to
+ * call while other threads are using the kernels.
+ */
+bool set_cipher_backend(const std::string& name);
@@ -0,0 +1,125 @@
+#include "cipher.h"
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Straightforward byte-at-a-time version of the .cat cipher to check the kernels against
+static std::vector<uint8_t> reference_cat_cipher(const std::vector<uint8_t>& data, size_t pos) {
+	std::vector<uint8_t> out(data.size());
+	uint8_t magic = (uint8_t)(CAT_MAGIC + pos);
+	for (size_t i = 0; i < data.size(); ++i) {
+		out[i] = data[i] ^ magic;
+		magic = (magic + 1) % 256;
+	}
+	return out;
+}
+
+static std::vector<uint8_t> make_data(size_t len) {
+	std::vector<uint8_t> data(len);
+	for (size_t i = 0; i < len; ++i) {
+		data[i] = (uint8_t)(i * 7 + 3);
+	}
+	return data;
+}
+
+TEST(cipher, backend_name) {
+	std::string name = cipher_backend();
+	EXPECT_TRUE(name == "scalar" || name == "sse2" || name == "avx2" || name == "avx512");
+}
+
+TEST(cipher, force_backend) {
+	// Scalar is always available
+	ASSERT_TRUE(set_cipher_backend("scalar"));
+	EXPECT_STREQ("scalar", cipher_backend());
+	EXPECT_FALSE(set_cipher_backend("not-a-backend"));
+	EXPECT_STREQ("scalar", cipher_backend());
+
+	ASSERT_TRUE(set_cipher_backend(""));
+	EXPECT_STRNE("", cipher_backend());
+}
+
+TEST(cipher, dat_matches_reference_all_backends) {
+	for (const char* backend : {"scalar", "sse2", "avx2", "avx512"}) {
+		if (!set_cipher_backend(backend)) {
+			continue; // Not supported on this CPU
+		}
+		for (size_t len : {0, 1, 15, 16, 17, 63, 64, 65, 127, 128, 129, 255, 256, 257, 4099}) {
+			auto data = make_data(len);
+			std::vector<uint8_t> out(len);
+
+			dat_cipher(data.data(), out.data(), len);
+			for (size_t i = 0; i < len; ++i) {
+				ASSERT_EQ(data[i] ^ DAT_MAGIC, out[i]) << backend << " len " << len << " at " << i;
+			}
+
+			// In place must give the same answer
+			dat_cipher(data.data(), data.data(), len);
+			ASSERT_EQ(out, data) << backend << " len " << len;
+		}
+	}
+	set_cipher_backend("");
+}
+
+TEST(cipher, cat_known_bytes) {
+	// "test.dat\n" as it appears at the start of test_artifacts/test.cat
+	const uint8_t encrypted[] = {0xaf, 0xb9, 0xae, 0xaa, 0xf1, 0x84, 0x80, 0x96, 0xe9};
+	uint8_t out[sizeof(encrypted)];
+
+	cat_cipher(encrypted, out, sizeof(encrypted));
+	EXPECT_EQ(0, memcmp(out, "test.dat\n", sizeof(out)));
+}
+
+TEST(cipher, cat_matches_reference) {
+	// Cover every tail length around the vector widths and a few starting keys
+	for (const char* backend : {"scalar", "sse2", "avx2", "avx512"}) {
+		if (!set_cipher_backend(backend)) {
+			continue; // Not supported on this CPU
+		}
+		for (size_t len : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 255, 256, 257, 1000}) {
+			for (size_t pos : {0, 1, 37, 255, 256, 1001}) {
+				auto data = make_data(len);
+				std::vector<uint8_t> out(len);
+
+				cat_cipher(data.data(), out.data(), len, pos);
+				ASSERT_EQ(reference_cat_cipher(data, pos), out) << backend << " len " << len << " pos " << pos;
+			}
+		}
+	}
+	set_cipher_backend("");
+}
+
+TEST(cipher, cat_in_place_round_trip) {
+	auto original = make_data(4099);
+	auto data = original;
+
+	cat_cipher(data.data(), data.data(), data.size());
+	EXPECT_NE(original, data);
+	cat_cipher(data.data(), data.data(), data.size());
+	EXPECT_EQ(original, data);
+}
+
+TEST(cipher, cat_chunks_match_whole) {
+	auto data = make_data(10000);
+	std::vector<uint8_t> whole(data.size());
+	std::vector<uint8_t> chunked(data.size());
+
+	cat_cipher(data.data(), whole.data(), data.size());
+	for (size_t start = 0; start < data.size(); start += 333) {
+		size_t n = std::min<size_t>(333, data.size() - start);
+		cat_cipher(data.data() + start, chunked.data() + start, n, start);
+	}
+	EXPECT_EQ(whole, chunked);
+}
+
+TEST(cipher, cat_parallel_matches_serial) {
+	// Large enough to be split across threads on a multi-core machine
+	auto data = make_data(9 * 1024 * 1024 + 123);
+	std::vector<uint8_t> serial(data.size());
+	std::vector<uint8_t> parallel(data.size());
+
+	cat_cipher(data.data(), serial.data(), data.size(), 5);
+	cat_cipher_parallel(data.data(), parallel.data(), data.size(), 5);
+	EXPECT_EQ(serial, parallel);
+}
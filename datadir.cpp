@@ -1,13 +1,23 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <regex>
 #include <string>
 #include <filesystem>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "datadir.h"
+#include "parallel.h"
+#include "path_pattern.h"
+#include "uring_extractor.h"
 
 
-datadir::datadir(const std::string& path) : m_largest_id(0) {
+datadir::datadir(const std::string& path, unsigned jobs) : m_jobs(jobs), m_largest_id(0) {
 	// Iterate through all files in the path, looking for cat files
 	std::filesystem::path dir_path(path);
 
@@ -17,17 +27,58 @@ datadir::datadir(const std::string& path) : m_largest_id(0) {
 	}
 
 	// Iterate through directory entries
+	std::vector<std::pair<uint32_t, std::string>> catalogs;
 	for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
 		if (entry.is_regular_file()) {
 			std::string filename = entry.path().string();
 
 			// Check if it's a .cat file
 			if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".cat") {
-				// Try to add the datafile
-				add(filename);
+				try {
+					catalogs.emplace_back(get_id_from_filename(filename), filename);
+				} catch (const std::exception&) {
+					// Not a numbered catalog, so not part of the game data
+				}
 			}
 		}
 	}
+
+	// Directory order is arbitrary, so sort to make sure the same catalog wins if two share an ID
+	std::sort(catalogs.begin(), catalogs.end());
+	for (auto& [id, filename] : catalogs) {
+		m_unloaded.emplace(id, std::move(filename));
+		m_largest_id = std::max(m_largest_id, id);
+	}
+}
+
+void datadir::load_all() {
+	if (m_unloaded.empty()) {
+		return;
+	}
+
+	// Reading and decrypting the catalogs is where the time goes, and they don't depend on each other
+	std::vector<std::pair<uint32_t, std::string>> catalogs(m_unloaded.begin(), m_unloaded.end());
+	m_unloaded.clear();
+	m_unloaded_blooms.clear();
+
+	std::vector<datafile> parsed(catalogs.size());
+	std::atomic<size_t> next(0);
+	std::atomic<bool> any_parsed(false);
+	unsigned jobs = m_jobs ? m_jobs : std::max(1u, std::thread::hardware_concurrency());
+	run_workers(std::min<size_t>(jobs, catalogs.size()), [&](unsigned) {
+		for (size_t i = next++; i < catalogs.size(); i = next++) {
+			if (!load_catalog(catalogs[i].first, catalogs[i].second, parsed[i])) {
+				any_parsed = true;
+			}
+		}
+	});
+	if (any_parsed) {
+		m_cache_dirty = true;
+	}
+
+	for (size_t i = 0; i < catalogs.size(); ++i) {
+		insert(catalogs[i].first, catalogs[i].second, std::move(parsed[i]));
+	}
 }
 
 bool datadir::add(const std::string& datafile_path) {
@@ -41,19 +92,15 @@ bool datadir::add(const std::string& datafile_path) {
 	}
 
 	// If the ID already exists, fail the add
-	if (m_dir_idx.find(id) != m_dir_idx.end()) {
+	if (has_id(id)) {
 		return false;
 	}
 
-	// Store the mappings
-	m_name_map[datafile_path] = id;
-	m_dir_idx.emplace(id, datafile_path);
-
-	if (id > m_largest_id) {
-		m_largest_id = id;
+	datafile df;
+	if (!load_catalog(id, datafile_path, df)) {
+		m_cache_dirty = true;
 	}
-
-	return true;
+	return insert(id, datafile_path, std::move(df));
 }
 
 bool datadir::add(datafile& file) {
@@ -64,15 +111,32 @@ bool datadir::add(datafile& file) {
 	}
 	uint32_t id = get_id_from_filename(filename);
 
-	if (m_dir_idx.find(id) != m_dir_idx.end()) {
+	if (has_id(id)) {
+		return false;
+	}
+
+	// Keep a copy of our own, the caller's datafile stays as it is
+	datafile df;
+	df.parse(filename, true);
+	return insert(id, filename, std::move(df));
+}
+
+bool datadir::insert(uint32_t id, const std::string& datafile_path, datafile&& df) {
+	auto [it, inserted] = m_dir_idx.emplace(id, std::move(df));
+	if (!inserted) {
 		return false;
 	}
 
-	// Store the filename mapping
-	m_name_map[filename] = id;
+	// Store the mappings
+	m_name_map[datafile_path] = id;
+	it->second.set_ignore_case(m_ignore_case);
+	merge_index(id, it->second);
 
-	// Create a datafile in-place in the map
-	m_dir_idx.emplace(id, filename);
+	it->second.unpack_on_extract(m_unpack_on_extract);
+	it->second.drop_cache_after_extract(m_drop_cache);
+	if (m_buffer_size) {
+		it->second.set_buffer_size(m_buffer_size);
+	}
 
 	if (id > m_largest_id) {
 		m_largest_id = id;
@@ -81,69 +145,507 @@ bool datadir::add(datafile& file) {
 	return true;
 }
 
-datafile* datadir::search(const std::string& filename, bool strict_match) {
-	// Search from highest ID down to 0
-	// Start at m_largest_id and work down
-	for (uint32_t curr = m_largest_id; curr > 0; --curr) {
-		// Check if this ID exists in our map
-		auto it = m_dir_idx.find(curr);
-		if (it != m_dir_idx.end()) {
-			// Check if this datafile contains the file
-			datafile& df = it->second;
-			if (df.has_file(filename, strict_match)) {
-				return &df;
+void datadir::merge_index(uint32_t id, datafile& df) {
+	const auto& entries = df.get_entries();
+	m_tree_dirty = true;
+	m_path_overlay.reserve(m_path_overlay.size() + entries.size());
+
+	for (const auto& entry : entries) {
+		std::string_view key = df.get_key(entry);
+
+		// Find where this archive belongs in the chain of versions of this path
+		overlay_entry** link = &m_path_overlay[key];
+		while (*link && (*link)->id > id) {
+			link = &(*link)->shadowed;
+		}
+		if (*link && (*link)->id == id) {
+			// The path is repeated within one catalog; the first one is the one that counts
+			continue;
+		}
+		overlay_entry* version = &m_overlay.emplace_back(overlay_entry{id, &df, &entry, *link});
+		*link = version;
+
+		// A filename goes to the highest archive that has it, and the first entry within that archive
+		auto [name_it, inserted] = m_name_overlay.try_emplace(datafile::filename_part(key), version);
+		if (!inserted && name_it->second->id < id) {
+			name_it->second = version;
+		}
+	}
+}
+
+const datadir::overlay_entry* datadir::find(std::string_view filename, bool strict_match) {
+	for (;;) {
+		const overlay_entry* found = find_loaded(filename, strict_match);
+
+		// The next catalog down that might have the file. Catalogs whose cached Bloom filter
+		// rules the file out are passed over without being loaded.
+		auto next = m_unloaded.rbegin();
+		while (next != m_unloaded.rend()) {
+			auto filter = m_unloaded_blooms.find(next->first);
+			if (filter == m_unloaded_blooms.end() || datafile::may_contain(filter->second, filename, strict_match)) {
+				break;
 			}
+			++next;
+		}
+
+		// Everything that could still have the file is outranked by what was found, so nothing can beat it
+		if (next == m_unloaded.rend() || (found && found->id > next->first)) {
+			return found;
+		}
+
+		// Otherwise the next catalog might have a better answer
+		uint32_t id = next->first;
+		std::string filename_path = std::move(next->second);
+		m_unloaded.erase(id);
+		m_unloaded_blooms.erase(id);
+
+		datafile df;
+		if (!load_catalog(id, filename_path, df)) {
+			m_cache_dirty = true;
+		}
+		insert(id, filename_path, std::move(df));
+	}
+}
+
+std::vector<const datadir::overlay_entry*> datadir::find_all(const std::vector<std::string>& names, bool strict_match) {
+	load_all();
+
+	// Lookups in the loaded index only read it, so any number of them can run at once
+	std::vector<const overlay_entry*> results(names.size());
+	unsigned jobs = m_jobs ? m_jobs : std::max(1u, std::thread::hardware_concurrency());
+	run_ranges(jobs, {{0, names.size()}}, [&](unsigned, size_t i) {
+		results[i] = find_loaded(names[i], strict_match);
+		return true;
+	});
+	return results;
+}
+
+bool datadir::load_catalog(uint32_t id, const std::string& datafile_path, datafile& df) const {
+	// Set this first, so the index is only built once
+	df.set_ignore_case(m_ignore_case);
+
+	if (m_cache.load(id, datafile_path, df)) {
+		return true;
+	}
+
+	// Only the index is ever used from here, so there's no need to keep the catalog text around
+	df.parse(datafile_path, true);
+	return false;
+}
+
+void datadir::use_cache(const std::filesystem::path& cache_path) {
+	m_cache_path = cache_path;
+	// A missing or broken cache just means everything gets parsed, and then saved
+	if (!m_cache.open(cache_path)) {
+		return;
+	}
+
+	// The filters are enough to keep searches away from catalogs that don't have the file
+	for (const auto& [id, filename] : m_unloaded) {
+		bloom_filter filter;
+		if (m_cache.load_bloom(id, filename, filter)) {
+			m_unloaded_blooms.emplace(id, std::move(filter));
 		}
 	}
+}
+
+bool datadir::save_cache() {
+	if (m_cache_path.empty() || !m_cache_dirty) {
+		return true;
+	}
+
+	std::map<uint32_t, const datafile*> catalogs;
+	for (const auto& [id, df] : m_dir_idx) {
+		catalogs.emplace(id, &df);
+	}
+
+	// Catalogs that were never needed stay in the cache if they are still current there.
+	// They are only read back for the write; as far as lookups go they are still not loaded.
+	std::map<uint32_t, datafile> from_cache;
+	for (const auto& [id, filename] : m_unloaded) {
+		datafile df;
+		if (m_cache.load(id, filename, df)) {
+			catalogs.emplace(id, &from_cache.emplace(id, std::move(df)).first->second);
+		}
+	}
+
+	if (!index_cache::write(m_cache_path, catalogs)) {
+		return false;
+	}
+	m_cache_dirty = false;
+	return true;
+}
+
+const datadir::overlay_entry* datadir::find_loaded(std::string_view filename, bool strict_match) const {
+	std::string key;
+	if (m_ignore_case) {
+		key = datafile::normalize_path(filename);
+		filename = key;
+	}
 
-	// File not found in any datafile
-	return nullptr;
+	if (strict_match) {
+		auto it = m_path_overlay.find(filename);
+		return it == m_path_overlay.end() ? nullptr : it->second;
+	}
+
+	auto it = m_name_overlay.find(datafile::filename_part(filename));
+	return it == m_name_overlay.end() ? nullptr : it->second;
+}
+
+datafile* datadir::search(const std::string& filename, bool strict_match) {
+	const overlay_entry* found = find(filename, strict_match);
+	return found ? found->file : nullptr;
 }
 
-bool datadir::extract(const std::filesystem::path& target_path) {
+bool datadir::extract(const std::filesystem::path& target_path, unsigned jobs) {
 	if (!std::filesystem::exists(target_path) || !std::filesystem::is_directory(target_path)) {
 		std::cerr << target_path << " does not exist or is not a directory\n";
 		return false;
 	}
 
-	// Build a map of file paths to the datafile with highest precedence
-	// Iterate from highest ID to lowest, so later iterations overwrite earlier ones
-	std::map<std::string, datafile*> file_precedence;
+	load_all();
+	std::vector<const overlay_entry*> order = extract_order();
 
-	for (uint32_t curr = m_largest_id; curr > 0; --curr) {
-		auto it = m_dir_idx.find(curr);
-		if (it != m_dir_idx.end()) {
-			datafile& df = it->second;
-			auto file_list = df.get_file_list();
-			for (const auto& filepath : file_list) {
-				// Only add if not already present (higher ID has precedence)
-				if (file_precedence.find(filepath) == file_precedence.end()) {
-					file_precedence[filepath] = &df;
-				}
+	// Directories are made as files need them, once each, whichever worker gets there first
+	output_dir out(target_path);
+	if (!out.is_open()) {
+		return false;
+	}
+
+	// Within each archive, files next to each other in the .dat file are read together
+	std::vector<const datafile::index_entry*> entries;
+	entries.reserve(order.size());
+	for (const overlay_entry* version : order) {
+		entries.push_back(version->entry);
+	}
+
+	// Each archive's runs are a unit of work, which a worker goes through front to back
+	std::vector<work_range> runs;
+	std::vector<work_range> archives;
+	for (size_t first = 0; first < order.size();) {
+		size_t last = first;
+		while (last < order.size() && order[last]->id == order[first]->id) {
+			++last;
+		}
+		archives.emplace_back(runs.size(), runs.size());
+		auto archive = std::span(entries).subspan(first, last - first);
+		for (auto [run_first, run_last] : datafile::coalesce(archive, order[first]->file->coalesce_limit())) {
+			runs.emplace_back(first + run_first, first + run_last);
+		}
+		archives.back().second = runs.size();
+		first = last;
+	}
+
+	std::vector<std::vector<uint8_t>> buffers(std::max(1u, jobs));
+	std::vector<std::unique_ptr<uring_extractor>> rings(buffers.size());
+	bool ret = run_ranges(jobs, archives, [&](unsigned worker, size_t idx) {
+		const work_range& run = runs[idx];
+		const datafile* file = order[run.first]->file;
+		auto entry_run = std::span(entries).subspan(run.first, run.second - run.first);
+
+		// Workers go through an archive's runs in order, so the next one is probably wanted soon
+		if (idx + 1 < runs.size() && order[runs[idx + 1].first]->file == file) {
+			file->prefetch(std::span(entries).subspan(runs[idx + 1].first, runs[idx + 1].second - runs[idx + 1].first));
+		}
+
+		if (m_use_io_uring && !rings[worker]) {
+			rings[worker] = std::make_unique<uring_extractor>(out, file->coalesce_limit());
+		}
+		bool extracted = rings[worker] ? rings[worker]->add(*file, entry_run)
+		                               : file->extract_run(entry_run, out, buffers[worker]);
+		if (!extracted) {
+			std::cerr << "Failed to extract from " << file->get_catfile_name() << "\n";
+			return false;
+		}
+		return true;
+	}, [&](unsigned worker) {
+		// Wait for what this worker's ring still has in flight, and close it on the thread that used it
+		bool finished = !rings[worker] || rings[worker]->finish();
+		rings[worker].reset();
+		return finished;
+	});
+	return ret;
+}
+
+void datadir::build_tree() {
+	m_tree.children.clear();
+
+	for (const auto& [key, version] : m_path_overlay) {
+		// The key and the path are the same length with the same separators, normalized or not
+		std::string_view path = version->entry->relpath;
+		dir_node* node = &m_tree;
+		size_t start = 0;
+		for (;;) {
+			size_t slash = key.find('/', start);
+			size_t len = (slash == std::string_view::npos ? key.size() : slash) - start;
+			dir_node& child = node->children[key.substr(start, len)];
+			if (child.name.empty()) {
+				child.name = path.substr(start, len);
+			}
+			node = &child;
+
+			if (slash == std::string_view::npos) {
+				break;
+			}
+			start = slash + 1;
+		}
+		node->file = version;
+	}
+
+	m_tree_dirty = false;
+}
+
+bool datadir::list(std::string_view dir, std::vector<dir_entry>& entries) {
+	load_all();
+	if (m_tree_dirty) {
+		build_tree();
+	}
+
+	std::string key(dir);
+	if (m_ignore_case) {
+		key = datafile::normalize_path(key);
+	}
+
+	const dir_node* node = &m_tree;
+	size_t start = 0;
+	while (start < key.size()) {
+		size_t slash = key.find('/', start);
+		if (slash == std::string::npos) {
+			slash = key.size();
+		}
+		// Skip empty components, so that leading, trailing and doubled slashes don't matter
+		if (slash > start) {
+			auto it = node->children.find(std::string_view(key).substr(start, slash - start));
+			if (it == node->children.end()) {
+				return false;
+			}
+			node = &it->second;
+		}
+		start = slash + 1;
+	}
+
+	if (node != &m_tree && node->children.empty()) {
+		// That's a file
+		return false;
+	}
+
+	entries.clear();
+	entries.reserve(node->children.size());
+	for (const auto& [name, child] : node->children) {
+		if (child.file) {
+			entries.push_back({child.name, child.file});
+		}
+		// A name can be a file in one archive and a directory in another
+		if (!child.children.empty()) {
+			entries.push_back({child.name, nullptr});
+		}
+	}
+	return true;
+}
+
+void datadir::collect(const dir_node& node, std::vector<const overlay_entry*>& results) {
+	for (const auto& [name, child] : node.children) {
+		if (child.file) {
+			results.push_back(child.file);
+		}
+		collect(child, results);
+	}
+}
+
+void datadir::match_glob(const dir_node& node,
+                         const std::vector<std::string_view>& parts,
+                         size_t depth,
+                         std::vector<const overlay_entry*>& results) const {
+	std::string_view part = parts[depth];
+	bool last = depth + 1 == parts.size();
+
+	if (part == "**") {
+		if (last) {
+			collect(node, results);
+			return;
+		}
+		// Either it stands for no more directories, or it takes in one more and stays put
+		match_glob(node, parts, depth + 1, results);
+		for (const auto& [name, child] : node.children) {
+			if (!child.children.empty()) {
+				match_glob(child, parts, depth, results);
 			}
 		}
+		return;
+	}
+
+	auto visit = [&](const dir_node& child) {
+		if (!last) {
+			match_glob(child, parts, depth + 1, results);
+		} else if (child.file) {
+			results.push_back(child.file);
+		}
+	};
+
+	if (!has_wildcards(part)) {
+		auto it = node.children.find(part);
+		if (it != node.children.end()) {
+			visit(it->second);
+		}
+		return;
+	}
+	for (const auto& [name, child] : node.children) {
+		if (glob_match(part, name)) {
+			visit(child);
+		}
+	}
+}
+
+bool datadir::match(std::string_view pattern, bool regex, std::vector<const overlay_entry*>& results) {
+	load_all();
+	if (m_tree_dirty) {
+		build_tree();
 	}
+	results.clear();
 
-	// Extract each file from the correct datafile
-	for (const auto& [filepath, df] : file_precedence) {
-		std::filesystem::path output_file = target_path / filepath;
+	if (!regex) {
+		std::string key(pattern);
+		if (m_ignore_case) {
+			key = datafile::normalize_path(key);
+		}
 
-		if (!df->extract_one_file(filepath, output_file, true)) {
-			std::cerr << "Failed to extract " << filepath << " from " << df->get_catfile_name() << "\n";
+		std::vector<std::string_view> parts;
+		std::string_view rest = key;
+		while (!rest.empty()) {
+			size_t slash = std::min(rest.find('/'), rest.size());
+			if (slash > 0) {
+				parts.push_back(rest.substr(0, slash));
+			}
+			rest.remove_prefix(std::min(slash + 1, rest.size()));
+		}
+		if (!parts.empty()) {
+			match_glob(m_tree, parts, 0, results);
+		}
+	} else {
+		std::regex re;
+		try {
+			auto flags = std::regex::ECMAScript | std::regex::optimize;
+			re = std::regex(std::string(pattern), m_ignore_case ? flags | std::regex::icase : flags);
+		} catch (const std::regex_error& e) {
+			std::cerr << "Invalid regular expression " << pattern << ": " << e.what() << std::endl;
 			return false;
 		}
+
+		// Walk down to the directory the literal start of the expression leads to...
+		std::string prefix = regex_literal_prefix(pattern);
+		if (m_ignore_case) {
+			prefix = datafile::normalize_path(prefix);
+		}
+		const dir_node* node = &m_tree;
+		std::string_view rest = prefix;
+		for (size_t slash = rest.find('/'); node && slash != std::string_view::npos; slash = rest.find('/')) {
+			auto it = node->children.find(rest.substr(0, slash));
+			node = it == node->children.end() ? nullptr : &it->second;
+			rest.remove_prefix(slash + 1);
+		}
+
+		// ...and only look at the entries in it that start with the rest of the prefix
+		std::vector<const overlay_entry*> candidates;
+		if (node) {
+			for (auto it = node->children.lower_bound(rest); it != node->children.end() && it->first.starts_with(rest);
+			     ++it) {
+				if (it->second.file) {
+					candidates.push_back(it->second.file);
+				}
+				collect(it->second, candidates);
+			}
+		}
+
+		std::string path;
+		for (const overlay_entry* candidate : candidates) {
+			path = candidate->entry->relpath;
+			if (m_ignore_case) {
+				path = datafile::normalize_path(path);
+			}
+			if (std::regex_match(path, re)) {
+				results.push_back(candidate);
+			}
+		}
 	}
 
+	// "**" can reach the same file more than one way
+	std::sort(results.begin(), results.end(), [](const overlay_entry* a, const overlay_entry* b) {
+		return a->entry->relpath < b->entry->relpath;
+	});
+	results.erase(std::unique(results.begin(), results.end()), results.end());
 	return true;
 }
 
+std::vector<const datadir::overlay_entry*> datadir::extract_order() const {
+	// The merged index already has the version with the highest precedence for every path
+	std::vector<const overlay_entry*> order;
+	order.reserve(m_path_overlay.size());
+	for (const auto& [filepath, version] : m_path_overlay) {
+		order.push_back(version);
+	}
+
+	// Go through one archive at a time, front to back, so each .dat is read in a single forward sweep
+	std::sort(order.begin(), order.end(), [](const overlay_entry* a, const overlay_entry* b) {
+		if (a->id != b->id) {
+			return a->id < b->id;
+		}
+		return a->entry->offset < b->entry->offset;
+	});
+	return order;
+}
+
+void datadir::ignore_case(bool enable) {
+	if (enable == m_ignore_case) {
+		return;
+	}
+	m_ignore_case = enable;
+
+	// The merged index is keyed the same way as the datafiles, so it has to be built again
+	m_tree_dirty = true;
+	m_overlay.clear();
+	m_path_overlay.clear();
+	m_name_overlay.clear();
+	for (auto& [id, df] : m_dir_idx) {
+		df.set_ignore_case(enable);
+		merge_index(id, df);
+	}
+}
+
 void datadir::unpack_on_extract(bool enable) {
-	// Set the flag on all datafiles in the directory
+	// Set the flag on all datafiles in the directory, and remember it for the ones loaded later
+	m_unpack_on_extract = enable;
 	for (auto& [id, df] : m_dir_idx) {
 		df.unpack_on_extract(enable);
 	}
 }
 
+void datadir::drop_cache_after_extract(bool enable) {
+	m_drop_cache = enable;
+	for (auto& [id, df] : m_dir_idx) {
+		df.drop_cache_after_extract(enable);
+	}
+}
+
+void datadir::set_buffer_size(size_t bytes) {
+	m_buffer_size = bytes;
+	for (auto& [id, df] : m_dir_idx) {
+		df.set_buffer_size(bytes);
+	}
+}
+
+bool datadir::map_datfiles(access_pattern pattern) {
+	// Mapping is only worth it for extraction, which needs every catalog anyway
+	load_all();
+
+	bool ret = true;
+	for (auto& [id, df] : m_dir_idx) {
+		if (!df.map_datfile(pattern)) {
+			ret = false;
+		}
+	}
+	return ret;
+}
+
 uint32_t datadir::get_id_from_filename(const std::string& filename) const {
 	// The normal case is that the file is named ##.cat, so we can just use that number
 	std::filesystem::path p(filename);
@@ -1,18 +1,55 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <filesystem>
 
 #include "datafile.h"
+#include "index_cache.h"
 
 /**
  * Represents an entire directory of .cat / .dat files.
  */
 class datadir {
 public:
-	datadir(const std::string& path);
+	/**
+	 * One version of a file in the directory.
+	 *
+	 * Every version of the same path is chained together from the highest archive ID
+	 * down, so the entry returned by find() is the one that wins and following
+	 * shadowed walks through the versions it hides.
+	 */
+	struct overlay_entry {
+		uint32_t id;
+		datafile* file;
+		const datafile::index_entry* entry;
+		overlay_entry* shadowed; // The next version down, or nullptr
+	};
+
+	/**
+	 * One item in a directory listing: a file, or a subdirectory if file is nullptr.
+	 */
+	struct dir_entry {
+		std::string_view name;
+		const overlay_entry* file;
+	};
+
+	/**
+	 * Track every numbered catalog in a directory.
+	 *
+	 * Catalogs are only read when an operation needs them. When several are needed at
+	 * once they are read on up to jobs threads; 0 means one per CPU core.
+	 */
+	datadir(const std::string& path, unsigned jobs = 0);
+
+	// The merged index points into the datafiles, so a datadir can't be copied
+	datadir(const datadir&) = delete;
+	datadir& operator=(const datadir&) = delete;
 
 	/**
 	 * Add a file pair to the list of tracked files by .cat file path
@@ -32,26 +69,158 @@ public:
 	 */
 	datafile* search(const std::string& filename, bool strict_match = false);
 
+	/**
+	 * Find the definitive version of a file, using the same matching rules as search().
+	 * Returns nullptr if no archive has the file.
+	 *
+	 * Catalogs are loaded from the highest ID down until the answer is certain, so the
+	 * shadowed chain only covers what has been loaded. Call load_all() first to get all of it.
+	 */
+	const overlay_entry* find(std::string_view filename, bool strict_match = false);
+
+	/**
+	 * Find the definitive versions of many files at once; results[i] is what find() gives
+	 * for names[i]. Every catalog is loaded up front, and the lookups are then shared out
+	 * between the same number of threads catalogs are loaded on.
+	 */
+	std::vector<const overlay_entry*> find_all(const std::vector<std::string>& names, bool strict_match = false);
+
+	/**
+	 * List a directory in the merged view of every archive: the versions of its files that
+	 * win, and its subdirectories, in name order. An empty path lists the top level.
+	 * Returns false if there is no such directory.
+	 *
+	 * This loads every catalog. The directory tree is built the first time it's needed,
+	 * after which a listing only costs the depth of the directory plus what's in it.
+	 */
+	bool list(std::string_view dir, std::vector<dir_entry>& entries);
+
+	/**
+	 * Find the definitive version of every file whose path matches a pattern, in path order.
+	 *
+	 * A glob is matched a directory at a time: '*' and '?' don't match '/', while a "**"
+	 * component matches any number of directories. A regular expression has to match the
+	 * whole path. Either way, only the part of the directory tree the literal start of the
+	 * pattern leads to is searched. Returns false if the pattern isn't valid.
+	 */
+	bool match(std::string_view pattern, bool regex, std::vector<const overlay_entry*>& results);
+
+	/**
+	 * Load every catalog that hasn't been loaded yet.
+	 */
+	void load_all();
+
+	/**
+	 * Read catalog indexes from a cache file where the cache is up to date, instead of
+	 * parsing the catalogs. The file doesn't have to exist yet.
+	 */
+	void use_cache(const std::filesystem::path& cache_path);
+
+	/**
+	 * Write the cache file given to use_cache(), if any catalog had to be parsed.
+	 * Catalogs that haven't been loaded are kept if the old cache has them.
+	 */
+	bool save_cache();
+
+	/** Name of the cache file x3tool keeps in a data directory */
+	static constexpr const char* CACHE_FILENAME = "x3tool.idx";
+
 	/**
 	 * Extract the data to a target directory, following the standard precendece rules.
+	 *
+	 * With more than one job, each archive's files are a unit of work for one worker,
+	 * and idle workers take over part of what's left of another worker's archive.
 	 */
-	bool extract(const std::filesystem::path& target_path);
+	bool extract(const std::filesystem::path& target_path, unsigned jobs = 1);
+
+	/**
+	 * Match paths the way the game does, ignoring case and treating '\\' the same as '/'.
+	 * Cheapest when called before anything is loaded.
+	 */
+	void ignore_case(bool enable = true);
 
 	/**
 	 * Enable or disable automatic unpacking of .pck files on extraction for all datafiles.
 	 */
 	void unpack_on_extract(bool enable = true);
 
+	/**
+	 * Set the size of the blocks files are streamed in when extracting, for all datafiles.
+	 */
+	void set_buffer_size(size_t bytes);
+
+	/**
+	 * Drop what extraction reads and writes from the page cache as it goes, for all datafiles.
+	 */
+	void drop_cache_after_extract(bool enable = true);
+
+	/**
+	 * Have extract() go through io_uring where the kernel has it; see uring_extractor.
+	 */
+	void use_io_uring(bool enable = true) { m_use_io_uring = enable; }
+
+	/**
+	 * Load every catalog and memory-map the .dat file of every datafile in the directory.
+	 * Datafiles that can't be mapped keep reading from the file; returns false if any failed.
+	 */
+	bool map_datfiles(access_pattern pattern = ACCESS_SEQUENTIAL);
+
 	// Getters for testing
-	size_t size() const { return m_dir_idx.size(); }
-	bool has_id(uint32_t id) const { return m_dir_idx.find(id) != m_dir_idx.end(); }
+	size_t size() const { return m_dir_idx.size() + m_unloaded.size(); }
+	size_t loaded() const { return m_dir_idx.size(); }
+	bool has_id(uint32_t id) const { return m_dir_idx.count(id) || m_unloaded.count(id); }
 
 private:
 	uint32_t get_id_from_filename(const std::string& filename) const;
+	bool insert(uint32_t id, const std::string& datafile_path, datafile&& df);
+	void merge_index(uint32_t id, datafile& df);
+	const overlay_entry* find_loaded(std::string_view filename, bool strict_match) const;
+	bool load_catalog(uint32_t id, const std::string& datafile_path, datafile& df) const;
+	std::vector<const overlay_entry*> extract_order() const;
+	void build_tree();
 
 	std::map<std::string, uint32_t> m_name_map;
 	std::map<uint32_t, datafile> m_dir_idx;
 
+	// Catalogs that have been found but not read yet, by ID
+	std::map<uint32_t, std::string> m_unloaded;
+	// Bloom filters of unloaded catalogs, for the ones the cache had
+	std::map<uint32_t, bloom_filter> m_unloaded_blooms;
+	unsigned m_jobs;
+
+	index_cache m_cache;
+	std::filesystem::path m_cache_path;
+	bool m_cache_dirty = false;
+
+	// Settings for datafiles, including ones that haven't been loaded yet
+	bool m_unpack_on_extract = false;
+	bool m_drop_cache = false;
+	bool m_ignore_case = false;
+	size_t m_buffer_size = 0;
+	bool m_use_io_uring = false;
+
+	// Merged index over every archive. The keys point into the datafiles' catalogs,
+	// which stay put because m_dir_idx never moves its elements.
+	std::deque<overlay_entry> m_overlay;
+	std::unordered_map<std::string_view, overlay_entry*> m_path_overlay;
+	std::unordered_map<std::string_view, overlay_entry*> m_name_overlay;
+
+	// Directory tree over the merged index, one node per path component. Names point into
+	// the catalogs, so a directory is only stored once however many paths go through it.
+	struct dir_node {
+		std::string_view name; // As spelled in the catalog, where the key may be normalized
+		const overlay_entry* file = nullptr;
+		std::map<std::string_view, dir_node> children;
+	};
+	void match_glob(const dir_node& node,
+	                const std::vector<std::string_view>& parts,
+	                size_t depth,
+	                std::vector<const overlay_entry*>& results) const;
+	static void collect(const dir_node& node, std::vector<const overlay_entry*>& results);
+
+	dir_node m_tree;
+	bool m_tree_dirty = true;
+
 	uint32_t m_largest_id;
 
 	// Friend class for testing private methods
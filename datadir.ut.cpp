@@ -2,6 +2,7 @@
 #include "test_utils.h"
 
 #include <filesystem>
+#include <vector>
 #include <gtest/gtest.h>
 
 // Test accessor class to access private methods
@@ -12,6 +13,8 @@ public:
 	}
 
 	static uint32_t get_largest_id(const datadir& dd) { return dd.m_largest_id; }
+
+	static std::vector<const datadir::overlay_entry*> extract_order(const datadir& dd) { return dd.extract_order(); }
 };
 
 // Test fixture
@@ -106,6 +109,56 @@ TEST_F(datadir_tests, constructor_loads_directory) {
 	ASSERT_EQ(10u, datadir_test_accessor::get_largest_id(composite_dd));
 }
 
+TEST_F(datadir_tests, constructor_parallel_matches_serial) {
+	datadir serial_dd{"test_artifacts/composite", 1};
+	datadir parallel_dd{"test_artifacts/composite", 8};
+	serial_dd.load_all();
+	parallel_dd.load_all();
+	ASSERT_EQ(3u, parallel_dd.loaded());
+
+	ASSERT_EQ(serial_dd.size(), parallel_dd.size());
+	for (const char* path : {"models/ship.mdl", "models/station.mdl", "scripts/main.lua", "sounds/engine.wav"}) {
+		const datadir::overlay_entry* serial = serial_dd.find(path, true);
+		const datadir::overlay_entry* parallel = parallel_dd.find(path, true);
+		ASSERT_TRUE(serial && parallel);
+		ASSERT_EQ(serial->id, parallel->id);
+		ASSERT_EQ(serial->entry->offset, parallel->entry->offset);
+	}
+}
+
+TEST_F(datadir_tests, search_loads_lazily) {
+	datadir composite_dd{"test_artifacts/composite"};
+	ASSERT_EQ(0u, composite_dd.loaded());
+
+	// Archive 10 has the answer, so nothing below it needs to be read
+	datafile* df = composite_dd.search("models/ship.mdl", true);
+	ASSERT_TRUE(df && df->get_catfile_name().find("10.cat") != std::string::npos);
+	ASSERT_EQ(1u, composite_dd.loaded());
+
+	// Archive 2 is needed for this one
+	df = composite_dd.search("station.mdl", false);
+	ASSERT_TRUE(df && df->get_catfile_name().find("2.cat") != std::string::npos);
+	ASSERT_EQ(2u, composite_dd.loaded());
+
+	// Already-loaded catalogs are reused
+	ASSERT_TRUE(composite_dd.search("hull.tex", false));
+	ASSERT_EQ(2u, composite_dd.loaded());
+
+	// A miss has to look at everything
+	ASSERT_FALSE(composite_dd.search("nonexistent.txt", false));
+	ASSERT_EQ(3u, composite_dd.loaded());
+	ASSERT_EQ(3u, composite_dd.size());
+}
+
+TEST_F(datadir_tests, search_after_adding_lower_archive) {
+	datadir composite_dd{"nonexistent_dir_12345"};
+	ASSERT_TRUE(composite_dd.add("test_artifacts/composite/1.cat"));
+	ASSERT_TRUE(composite_dd.add("test_artifacts/composite/10.cat"));
+
+	datafile* df = composite_dd.search("ship.mdl", false);
+	ASSERT_TRUE(df && df->get_catfile_name().find("10.cat") != std::string::npos);
+}
+
 TEST_F(datadir_tests, constructor_empty_directory) {
 	// Create a datadir pointing to a directory with no cat files
 	datadir empty_dd{"test"};
@@ -218,6 +271,167 @@ TEST_F(datadir_tests, search_complete_composite_precedence) {
 	ASSERT_TRUE(df8 && df8->get_catfile_name().find("1.cat") != std::string::npos);
 }
 
+TEST_F(datadir_tests, find_shadow_chain) {
+	datadir composite_dd{"test_artifacts/composite"};
+	composite_dd.load_all();
+
+	// models/ship.mdl is in all three archives, and each one hides the one below it
+	const datadir::overlay_entry* version = composite_dd.find("models/ship.mdl", true);
+	ASSERT_TRUE(version);
+	std::vector<uint32_t> ids;
+	for (; version; version = version->shadowed) {
+		ASSERT_EQ("models/ship.mdl", version->entry->relpath);
+		ids.push_back(version->id);
+	}
+	ASSERT_EQ(std::vector<uint32_t>({10, 2, 1}), ids);
+
+	// Only archive 1 has scripts/main.lua
+	version = composite_dd.find("main.lua", false);
+	ASSERT_TRUE(version);
+	ASSERT_EQ(1u, version->id);
+	ASSERT_FALSE(version->shadowed);
+
+	ASSERT_FALSE(composite_dd.find("nonexistent.txt", false));
+}
+
+TEST_F(datadir_tests, find_order_of_adding) {
+	// Archives added out of order still end up in precedence order
+	datadir dd{"nonexistent_dir_12345"};
+	ASSERT_TRUE(dd.add("test_artifacts/composite/2.cat"));
+	ASSERT_TRUE(dd.add("test_artifacts/composite/10.cat"));
+	ASSERT_TRUE(dd.add("test_artifacts/composite/1.cat"));
+
+	const datadir::overlay_entry* version = dd.find("models/ship.mdl", true);
+	ASSERT_TRUE(version);
+	ASSERT_EQ(10u, version->id);
+	ASSERT_EQ(2u, version->shadowed->id);
+	ASSERT_EQ(1u, version->shadowed->shadowed->id);
+	ASSERT_FALSE(version->shadowed->shadowed->shadowed);
+}
+
+TEST_F(datadir_tests, search_ignore_case) {
+	datadir composite_dd{"test_artifacts/composite"};
+	ASSERT_FALSE(composite_dd.search("Models/Ship.MDL", true));
+
+	composite_dd.ignore_case();
+	datafile* df = composite_dd.search("Models\\Ship.MDL", true);
+	ASSERT_TRUE(df && df->get_catfile_name().find("10.cat") != std::string::npos);
+	df = composite_dd.search("MAIN.LUA", false);
+	ASSERT_TRUE(df && df->get_catfile_name().find("1.cat") != std::string::npos);
+}
+
+TEST_F(datadir_tests, find_all) {
+	std::vector<std::string> names = {"models/ship.mdl", "main.lua", "missing.txt", "sounds/weapons.wav"};
+
+	datadir serial_dd{"test_artifacts/composite", 1};
+	auto serial = serial_dd.find_all(names);
+	ASSERT_EQ(names.size(), serial.size());
+	ASSERT_EQ(10u, serial[0]->id);
+	ASSERT_EQ(1u, serial[1]->id);
+	ASSERT_FALSE(serial[2]);
+	ASSERT_EQ(2u, serial[3]->id);
+
+	// Every catalog is loaded, so each answer is the same one find() would give
+	datadir parallel_dd{"test_artifacts/composite", 4};
+	auto parallel = parallel_dd.find_all(names);
+	ASSERT_EQ(3u, parallel_dd.loaded());
+	for (size_t i = 0; i < names.size(); ++i) {
+		const datadir::overlay_entry* found = parallel_dd.find(names[i]);
+		ASSERT_EQ(found, parallel[i]);
+		if (found) {
+			ASSERT_EQ(serial[i]->id, found->id);
+		}
+	}
+
+	ASSERT_TRUE(parallel_dd.find_all({}).empty());
+}
+
+TEST_F(datadir_tests, list) {
+	datadir composite_dd{"test_artifacts/composite"};
+	std::vector<datadir::dir_entry> entries;
+
+	ASSERT_TRUE(composite_dd.list("", entries));
+	ASSERT_EQ(4u, entries.size());
+	ASSERT_EQ("models", entries[0].name);
+	ASSERT_FALSE(entries[0].file);
+	ASSERT_EQ("textures", entries[3].name);
+
+	// Leading and trailing slashes don't matter
+	ASSERT_TRUE(composite_dd.list("/models/", entries));
+	ASSERT_EQ(2u, entries.size());
+	ASSERT_EQ("ship.mdl", entries[0].name);
+	ASSERT_TRUE(entries[0].file);
+	ASSERT_EQ(10u, entries[0].file->id);
+	ASSERT_EQ(16u, entries[0].file->entry->size);
+	ASSERT_EQ("station.mdl", entries[1].name);
+	ASSERT_EQ(2u, entries[1].file->id);
+
+	ASSERT_FALSE(composite_dd.list("missing", entries));
+	ASSERT_FALSE(composite_dd.list("models/ship.mdl", entries));
+	ASSERT_FALSE(composite_dd.list("Models", entries));
+
+	// The names come out as the catalogs spell them, whatever the query looks like
+	composite_dd.ignore_case();
+	ASSERT_TRUE(composite_dd.list("SCRIPTS\\", entries));
+	ASSERT_EQ(2u, entries.size());
+	ASSERT_EQ("init.lua", entries[0].name);
+	ASSERT_EQ(2u, entries[0].file->id);
+	ASSERT_EQ("main.lua", entries[1].name);
+	ASSERT_EQ(1u, entries[1].file->id);
+}
+
+static std::vector<std::string> match_paths(datadir& dd, const char* pattern, bool regex) {
+	std::vector<const datadir::overlay_entry*> results;
+	EXPECT_TRUE(dd.match(pattern, regex, results));
+	std::vector<std::string> paths;
+	for (const auto* result : results) {
+		paths.emplace_back(result->entry->relpath);
+	}
+	return paths;
+}
+
+TEST_F(datadir_tests, match_glob) {
+	using paths = std::vector<std::string>;
+	datadir composite_dd{"test_artifacts/composite"};
+
+	ASSERT_EQ(paths({"models/ship.mdl", "models/station.mdl"}), match_paths(composite_dd, "models/*", false));
+	ASSERT_EQ(paths({"scripts/init.lua", "scripts/main.lua"}), match_paths(composite_dd, "*/*.lua", false));
+	ASSERT_EQ(paths({"textures/hull.tex"}), match_paths(composite_dd, "**/hull.tex", false));
+	ASSERT_EQ(8u, match_paths(composite_dd, "**", false).size());
+	// '*' stays inside one directory
+	ASSERT_TRUE(match_paths(composite_dd, "*.mdl", false).empty());
+	ASSERT_TRUE(match_paths(composite_dd, "missing/*", false).empty());
+
+	// Every match comes with the version that wins
+	std::vector<const datadir::overlay_entry*> results;
+	ASSERT_TRUE(composite_dd.match("sounds/*.wav", false, results));
+	ASSERT_EQ(2u, results.size());
+	ASSERT_EQ(10u, results[0]->id);
+	ASSERT_EQ(2u, results[1]->id);
+
+	composite_dd.ignore_case();
+	ASSERT_EQ(paths({"models/ship.mdl"}), match_paths(composite_dd, "MODELS\\SH*", false));
+}
+
+TEST_F(datadir_tests, match_regex) {
+	using paths = std::vector<std::string>;
+	datadir composite_dd{"test_artifacts/composite"};
+
+	ASSERT_EQ(paths({"models/ship.mdl", "models/station.mdl"}), match_paths(composite_dd, "models/s.*", true));
+	ASSERT_EQ(paths({"models/station.mdl", "sounds/engine.wav"}),
+	          match_paths(composite_dd, "models/st.*|.*/engine\\.wav", true));
+	ASSERT_EQ(paths({"scripts/main.lua", "textures/cockpit.tex"}),
+	          match_paths(composite_dd, "(scripts/m|textures/c).*", true));
+	// The whole path has to match
+	ASSERT_TRUE(match_paths(composite_dd, "models", true).empty());
+
+	std::vector<const datadir::overlay_entry*> results;
+	ASSERT_FALSE(composite_dd.match("models/(", true, results));
+
+	composite_dd.ignore_case();
+	ASSERT_EQ(paths({"models/ship.mdl"}), match_paths(composite_dd, "Models/SH.*", true));
+}
+
 TEST_F(datadir_tests, extract_composite_archives) {
 	// Create output directory
 	std::filesystem::path extract_dir = "test_extract_composite";
@@ -259,6 +473,40 @@ TEST_F(datadir_tests, extract_composite_archives) {
 	std::filesystem::remove_all(extract_dir);
 }
 
+TEST_F(datadir_tests, extract_order) {
+	datadir composite_dd{"test_artifacts/composite"};
+	composite_dd.load_all();
+
+	// One winner per path, grouped by archive and in .dat order within each archive
+	auto order = datadir_test_accessor::extract_order(composite_dd);
+	ASSERT_EQ(8u, order.size());
+	for (size_t i = 1; i < order.size(); ++i) {
+		ASSERT_LE(order[i - 1]->id, order[i]->id);
+		if (order[i - 1]->id == order[i]->id) {
+			ASSERT_LT(order[i - 1]->entry->offset, order[i]->entry->offset);
+		}
+	}
+	ASSERT_EQ(1u, order.front()->id);
+	ASSERT_EQ(10u, order.back()->id);
+}
+
+TEST_F(datadir_tests, extract_composite_parallel) {
+	std::filesystem::path extract_dir = "test_extract_composite_parallel";
+	std::filesystem::remove_all(extract_dir);
+	std::filesystem::create_directories(extract_dir);
+
+	datadir composite_dd{"test_artifacts/composite"};
+	ASSERT_TRUE(composite_dd.extract(extract_dir, 4));
+
+	ASSERT_EQ("Model v10 FINAL\n", test_utils::read_file(extract_dir / "models/ship.mdl"));
+	ASSERT_EQ("Model v2 UPDATED\n", test_utils::read_file(extract_dir / "models/station.mdl"));
+	ASSERT_EQ("Sound v2 NEW\n", test_utils::read_file(extract_dir / "sounds/weapons.wav"));
+	ASSERT_EQ("Script v1\n", test_utils::read_file(extract_dir / "scripts/main.lua"));
+	ASSERT_EQ("Texture v1\n", test_utils::read_file(extract_dir / "textures/cockpit.tex"));
+
+	std::filesystem::remove_all(extract_dir);
+}
+
 TEST_F(datadir_tests, extract_nonexistent_directory) {
 	datadir composite_dd{"test_artifacts/composite"};
 
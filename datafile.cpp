@@ -1,6 +1,9 @@
 #include "datafile.h"
 
+#include "cipher.h"
+#include "parallel.h"
 #include "pck.h"
+#include "uring_extractor.h"
 
 #include <string>
 #include <list>
@@ -11,110 +14,280 @@
 #include <fstream>
 #include <filesystem>
 #include <iomanip>
+#include <algorithm>
+#include <charconv>
+#include <atomic>
+#include <cstring>
+#include <functional>
 
-#define dat_magic 0x33
-#define init_magic 0xdb
-#define next_magic(_magic) ((_magic + 1) % 256)
+// Size of the blocks build() reads input files in
+constexpr size_t dat_block_size = 64 * 1024; // 64 KB
 
 /**
- * Simple class for writing .cat files while keeping track of the magic encryption value.
+ * Simple class for writing .cat files while keeping track of the position for the rolling encryption key.
  */
 class cat_writer {
 public:
-	cat_writer(std::filesystem::path cat_path) : m_magic(init_magic), m_cat_path(cat_path) {}
+	cat_writer(std::filesystem::path cat_path) : m_pos(0), m_cat_path(cat_path) {}
 
 	bool open() {
-		m_catstream.open(m_cat_path);
+		m_catstream.open(m_cat_path, std::ios::out | std::ios::binary | std::ios::trunc);
 		return (bool)m_catstream;
 	}
 
 	bool write(const std::string& data) {
-		for (char c : data) {
-			m_catstream.put(c ^ m_magic);
-			m_magic = next_magic(m_magic);
-		}
+		m_buffer.resize(data.size());
+		cat_cipher((const uint8_t*)data.data(), m_buffer.data(), data.size(), m_pos);
+		m_pos += data.size();
+
+		m_catstream.write((const char*)m_buffer.data(), m_buffer.size());
+		return (bool)m_catstream;
+	}
 
-		m_catstream << std::flush;
+	bool close() {
+		m_catstream.close();
 		return (bool)m_catstream;
 	}
 
 private:
-	uint8_t m_magic;
+	size_t m_pos;
 	std::filesystem::path m_cat_path;
 	std::ofstream m_catstream;
+	std::vector<uint8_t> m_buffer;
 };
 
-// Read in a file
-static std::vector<uint8_t> read_file_to_vector(const std::filesystem::path& file_path) {
-	std::ifstream infile(file_path, std::ios::in | std::ios::binary);
-	if (!infile) {
-		return {};
-	}
+bool datafile::parse(const std::filesystem::path& catfilename, bool compact) {
+	std::string datfilename;
+
+	// Decrypt the whole file first; the key only depends on the position, so this is one flat pass.
+	// Decrypting straight out of a mapping means the encrypted text never needs a buffer of its own.
+	{
+		mapped_file encrypted_cat;
+		if (!encrypted_cat.open(catfilename, ACCESS_SEQUENTIAL) || encrypted_cat.size() == 0) {
+			clear_index();
+			return false;
+		}
 
-	// Get file size
-	infile.seekg(0, std::ios::end);
-	std::streamsize size = infile.tellg();
-	infile.seekg(0, std::ios::beg);
+		m_unencrypted_cat.resize(encrypted_cat.size());
+		cat_cipher_parallel(encrypted_cat.data(), m_unencrypted_cat.data(), encrypted_cat.size());
+	}
+	m_compact = false;
+
+	// Then split it into lines and build the index
+	const char line_end = 0x0a;
+	const char* text = (const char*)m_unencrypted_cat.data();
+	const char* text_end = text + m_unencrypted_cat.size();
+
+	m_index.clear();
+	m_index.reserve(std::count(text, text_end, line_end));
+
+	uint64_t running_offset = 0;
+	bool first_line = true;
+	for (const char* line = text; line < text_end;) {
+		const char* eol = (const char*)memchr(line, line_end, text_end - line);
+		if (!eol) {
+			// An unterminated last line is not an entry
+			break;
+		}
+		size_t len = eol - line;
+
+		if (first_line) { // The first line is the name of the data file
+			datfilename = std::string(line, len);
+			first_line = false;
+		} else if (const char* space = (const char*)memrchr(line, ' ', len)) {
+			// An entry looks like:
+			// <filename> <size>
+			std::string_view relpath(line, space - line);
+			uint64_t size = 0;
+			auto parsed = std::from_chars(space + 1, eol, size);
+			if (parsed.ec == std::errc::result_out_of_range || size > UINT64_MAX - running_offset) {
+				std::cerr << "Entry " << relpath << " in " << catfilename << " is too large\n";
+				clear_index();
+				return false;
+			}
+			m_index.emplace_back(relpath, running_offset, size);
+			running_offset += size;
+		}
+		line = eol + 1;
+	}
 
-	// Read into vector
-	std::vector<uint8_t> buffer(size);
-	infile.read((char*)buffer.data(), size);
+	m_catfile = catfilename.string();
+	m_cat_header = datfilename;
+	set_datafile(datfilename);
+	if (compact) {
+		// Before the lookups are built, so they only have to be built once
+		pack_paths();
+		m_compact = true;
+	}
+	build_lookup();
 
-	return buffer;
+	return true;
 }
 
-bool datafile::parse(const std::filesystem::path& catfilename) {
-	std::vector<uint8_t> encrypted_cat = read_file_to_vector(catfilename);
-	std::string datfilename;
-
-	if (encrypted_cat.size() == 0) {
+bool datafile::load_compact(const std::filesystem::path& catfilename,
+                            const std::string& header,
+                            std::string_view paths,
+                            std::span<const uint64_t> sizes,
+                            std::span<const uint32_t> path_lengths) {
+	if (sizes.size() != path_lengths.size()) {
+		clear_index();
 		return false;
 	}
-	m_unencrypted_cat.resize(encrypted_cat.size());
-
-	// Decrypt the file and build the index
-	uint32_t running_offset = 0;
-	uint32_t lineptr = 0;
-	uint32_t last_space = 0;
-	uint8_t magic = init_magic;
-	for (uint32_t idx = 0; idx < encrypted_cat.size(); ++idx) {
-		const char line_end = 0x0a;
-		m_unencrypted_cat[idx] = encrypted_cat[idx] ^ magic;
-		magic = next_magic(magic);
-
-		// Parse the line into an index entry
-		if (m_unencrypted_cat[idx] == line_end) {
-			if (last_space == 0) { // This is the first entry in the file
-				datfilename = std::string((char*)m_unencrypted_cat.data(), idx);
-			} else {
-				m_index.emplace_back(
-					(char*)&m_unencrypted_cat[lineptr], last_space - lineptr, idx - lineptr, running_offset);
-				running_offset += m_index.back().size;
-			}
-			lineptr = idx + 1;
-		} else if (m_unencrypted_cat[idx] == ' ') {
-			last_space = idx;
+
+	m_unencrypted_cat.assign(paths.begin(), paths.end());
+	m_index.clear();
+	m_index.reserve(sizes.size());
+
+	const char* path = (const char*)m_unencrypted_cat.data();
+	size_t used = 0;
+	uint64_t running_offset = 0;
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		if (path_lengths[i] > paths.size() - used || sizes[i] > UINT64_MAX - running_offset) {
+			clear_index();
+			return false;
 		}
+		m_index.emplace_back(std::string_view(path + used, path_lengths[i]), running_offset, sizes[i]);
+		used += path_lengths[i];
+		running_offset += sizes[i];
 	}
 
+	m_compact = true;
 	m_catfile = catfilename.string();
-	set_datafile(datfilename);
+	m_cat_header = header;
+	set_datafile(header);
+	build_lookup();
 
 	return true;
 }
 
+void datafile::clear_index() {
+	// The lookups and keys refer into the index and the catalog buffer, so they all go together
+	m_index.clear();
+	m_path_lookup.clear();
+	m_name_lookup.clear();
+	m_bloom = bloom_filter();
+	m_keys.clear();
+	m_unencrypted_cat.clear();
+	m_catfile.clear();
+	m_cat_header.clear();
+	m_compact = false;
+}
+
+std::string_view datafile::filename_part(std::string_view relpath) {
+	size_t slash = relpath.rfind('/');
+	if (slash == std::string_view::npos) {
+		return relpath;
+	}
+	return relpath.substr(slash + 1);
+}
+
+void datafile::normalize_path(const char* src, char* dst, size_t len) {
+	// No branches, so the compiler can do a whole vector of bytes at a time
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char c = src[i];
+		c = c == '\\' ? '/' : c;
+		dst[i] = c + ((unsigned char)(c - 'A') < 26 ? 'a' - 'A' : 0);
+	}
+}
+
+std::string datafile::normalize_path(std::string_view path) {
+	std::string key(path.size(), '\0');
+	normalize_path(path.data(), key.data(), path.size());
+	return key;
+}
+
+std::string_view datafile::get_key(const index_entry& entry) const {
+	if (!m_ignore_case) {
+		return entry.relpath;
+	}
+	// The keys are a normalized copy of the catalog buffer, so every path is at the same offset in both
+	return std::string_view(m_keys.data() + (entry.relpath.data() - (const char*)m_unencrypted_cat.data()),
+	                        entry.relpath.size());
+}
+
+void datafile::set_ignore_case(bool enable) {
+	if (enable != m_ignore_case) {
+		m_ignore_case = enable;
+		// The filter holds normalized keys either way
+		build_lookup(false);
+	}
+}
+
+void datafile::build_lookup(bool bloom) {
+	m_path_lookup.clear();
+	m_name_lookup.clear();
+	m_path_lookup.reserve(m_index.size());
+	m_name_lookup.reserve(m_index.size());
+	if (bloom) {
+		m_bloom = bloom_filter(m_index.size() * 2);
+	}
+
+	if (m_ignore_case) {
+		// One flat pass over the whole buffer, rather than one per path
+		m_keys.resize(m_unencrypted_cat.size());
+		normalize_path((const char*)m_unencrypted_cat.data(), m_keys.data(), m_keys.size());
+	} else {
+		m_keys.clear();
+		m_keys.shrink_to_fit();
+	}
+
+	// The filter always holds normalized keys, so that it works whichever way the lookups are done
+	std::string normalized;
+	for (size_t i = 0; i < m_index.size(); ++i) {
+		std::string_view key = get_key(m_index[i]);
+		// try_emplace keeps the first entry, which is the one a linear scan would have found
+		m_path_lookup.try_emplace(key, i);
+		m_name_lookup.try_emplace(filename_part(key), i);
+		if (!bloom) {
+			continue;
+		}
+
+		if (!m_ignore_case) {
+			normalized.resize(key.size());
+			normalize_path(key.data(), normalized.data(), key.size());
+			key = normalized;
+		}
+		m_bloom.add(key);
+		m_bloom.add(filename_part(key));
+	}
+}
+
+bool datafile::may_contain(const bloom_filter& filter, std::string_view filename, bool strict_match) {
+	std::string key = normalize_path(filename);
+	return filter.may_contain(strict_match ? std::string_view(key) : filename_part(key));
+}
+
+const datafile::index_entry* datafile::find_entry(std::string_view filename, bool strict_match) const {
+	std::string key;
+	if (m_ignore_case) {
+		key = normalize_path(filename);
+		filename = key;
+	}
+
+	if (strict_match) {
+		auto it = m_path_lookup.find(filename);
+		return it == m_path_lookup.end() ? nullptr : &m_index[it->second];
+	}
+
+	auto it = m_name_lookup.find(filename_part(filename));
+	return it == m_name_lookup.end() ? nullptr : &m_index[it->second];
+}
+
 bool write_file_to_dat(std::ostream& outfile, const std::filesystem::directory_entry& data) {
 	std::ifstream infile(data.path(), std::ios::in | std::ios::binary);
 	if (!infile) {
 		return false;
 	}
 
-	char c;
-	while (infile.get(c)) {
-		outfile.put(c ^ dat_magic);
+	std::vector<uint8_t> buffer(dat_block_size);
+	while (infile) {
+		infile.read((char*)buffer.data(), buffer.size());
+		size_t read_len = infile.gcount();
+		dat_cipher(buffer.data(), buffer.data(), read_len);
+		outfile.write((const char*)buffer.data(), read_len);
 	}
 
-	return (bool)outfile;
+	return !infile.bad() && (bool)outfile;
 }
 
 bool datafile::enumerate_directory(const std::filesystem::path& dir, std::set<std::filesystem::directory_entry>& fset) {
@@ -174,7 +347,7 @@ bool datafile::build(const std::filesystem::path& p, const std::filesystem::path
 	}
 
 	// Write the files
-	uint32_t running_offset = 0;
+	uint64_t running_offset = 0;
 
 	// The cat file starts with the filename of the corresponding dat file
 	std::string datfile_header = datfile.filename().string() + "\n";
@@ -200,9 +373,18 @@ bool datafile::build(const std::filesystem::path& p, const std::filesystem::path
 			return false;
 		}
 
+		if (curr_file.file_size() > UINT64_MAX - running_offset) {
+			std::cerr << "Data file would be too large after " << curr_file.path() << std::endl;
+			return false;
+		}
 		running_offset += curr_file.file_size();
 	}
 
+	if (!cwriter.close()) {
+		std::cerr << "Error when writing to cat file\n";
+		return false;
+	}
+
 	return true;
 }
 
@@ -224,87 +406,123 @@ bool datafile::decrypt_to_file(const std::filesystem::path& filename) const {
 		return false;
 	}
 
-	outfile.write((const char*)(m_unencrypted_cat.data()), m_unencrypted_cat.size());
+	if (m_compact) {
+		// The text is gone, so write out what it said
+		outfile << m_cat_header << "\n";
+		for (const auto& entry : m_index) {
+			outfile << entry.relpath << " " << entry.size << "\n";
+		}
+	} else {
+		outfile.write((const char*)(m_unencrypted_cat.data()), m_unencrypted_cat.size());
+	}
 	outfile.close();
-	return true;
+	return (bool)outfile;
+}
+
+void datafile::compact() {
+	if (m_compact) {
+		return;
+	}
+
+	pack_paths();
+	build_lookup(false);
+	m_compact = true;
+}
+
+void datafile::pack_paths() {
+	// Pack the paths at the front of the buffer. Each path only ever moves towards the front,
+	// and never past the end of the previous one, so this can be done in place.
+	uint8_t* base = m_unencrypted_cat.data();
+	size_t packed = 0;
+	for (auto& entry : m_index) {
+		size_t len = entry.relpath.size();
+		memmove(base + packed, entry.relpath.data(), len);
+		entry.relpath = std::string_view((const char*)base + packed, len);
+		packed += len;
+	}
+
+	// Shrinking moves the buffer, so repoint the paths at the new one
+	m_unencrypted_cat.resize(packed);
+	m_unencrypted_cat.shrink_to_fit();
+	const char* packed_path = (const char*)m_unencrypted_cat.data();
+	for (auto& entry : m_index) {
+		entry.relpath = std::string_view(packed_path, entry.relpath.size());
+		packed_path += entry.relpath.size();
+	}
 }
 
 std::vector<uint8_t> datafile::extract_one_file_to_buffer(const std::string& filename, bool strict_match) const {
-	const uint32_t block_size = 4096;
 	// Make sure the file is in our index
-	const index_entry* file_entry = nullptr;
-	for (const auto& entry : m_index) {
-		if (strict_match) {
-			if (entry == filename) {
-				file_entry = &entry;
-				break;
-			}
-		} else {
-			if (entry.filename_match(filename)) {
-				file_entry = &entry;
-				break;
-			}
-		}
-	}
+	const index_entry* file_entry = find_entry(filename, strict_match);
 	if (!file_entry) {
 		std::cout << "Could not find file " << filename << " in catalog\n";
 		return {};
 	}
 
-	// Open the data file
-	std::ifstream encoded_datafile(m_datfile, std::ios::in | std::ios::binary);
+	return extract_entry_to_buffer(*file_entry);
+}
 
-	if (!encoded_datafile) {
-		std::cerr << "Could not open data file " << m_datfile << std::endl;
-		return {};
+bool datafile::map_datfile(access_pattern pattern) {
+	if (!m_datmap.open(m_datfile, pattern)) {
+		std::cerr << "Could not map data file " << m_datfile << std::endl;
+		return false;
 	}
+	return true;
+}
+
+std::span<const uint8_t> datafile::get_entry_view(const index_entry& entry) const {
+	return m_datmap.view(entry.offset, entry.size);
+}
+
+bool datafile::needs_unpack(const index_entry& entry) const {
+	return m_unpack_on_extract && std::filesystem::path(entry.relpath).extension() == ".pck";
+}
 
-	// Allocate output buffer
+std::vector<uint8_t> datafile::extract_entry_to_buffer(const index_entry& entry) const {
 	std::vector<uint8_t> output;
-	output.reserve(file_entry->size);
-
-	// Read and decode the file
-	encoded_datafile.seekg(file_entry->offset);
-	uint8_t tmp[block_size];
-	uint32_t len = file_entry->size;
-	while ((len > 0) && encoded_datafile) {
-		// Read one chunk
-		uint32_t read_len = block_size;
-		if (read_len > len)
-			read_len = len;
-		encoded_datafile.read((char*)tmp, read_len);
-		read_len = encoded_datafile.gcount();
-		len -= read_len;
-
-		// Decode and append to buffer
-		for (uint32_t i = 0; i < read_len; ++i) {
-			tmp[i] ^= 0x33;
-		}
-		output.insert(output.end(), tmp, tmp + read_len);
-	}
 
-	if (len > 0 || !encoded_datafile) {
-		std::cerr << "I/O error while decoding file\n";
+	if (m_datmap.is_open()) {
+		// Decode straight from the mapping into the output buffer
+		auto encoded = get_entry_view(entry);
+		if (encoded.size() != entry.size) {
+			std::cerr << "Entry " << entry.relpath << " lies outside of " << m_datfile << std::endl;
+			return {};
+		}
+		output.resize(encoded.size());
+		dat_cipher(encoded.data(), output.data(), encoded.size());
+	} else if (!read_entry(entry, output)) {
 		return {};
 	}
 
-	encoded_datafile.close();
-
 	// Check if we need to unpack .pck files
-	if (m_unpack_on_extract) {
-		std::filesystem::path fpath(filename);
-		if (fpath.extension() == ".pck" && is_compressed(output.data(), output.size())) {
-			auto unpacked = unpack(output);
-			if (!unpacked.empty()) {
-				return unpacked;
-			}
-			// If unpacking failed, just return the original data
+	if (needs_unpack(entry) && is_compressed(output.data(), output.size())) {
+		auto unpacked = unpack(output);
+		if (!unpacked.empty()) {
+			return unpacked;
 		}
+		// If unpacking failed, just return the original data
 	}
 
 	return output;
 }
 
+bool datafile::read_entry(const index_entry& entry, std::vector<uint8_t>& output) const {
+	if (entry.size > output.max_size()) {
+		std::cerr << "Entry " << entry.relpath << " is too large to hold in memory\n";
+		return false;
+	}
+
+	// Read straight into the output buffer and decode it in place
+	output.resize(entry.size);
+	if (!m_datreader.read_at(output.data(), entry.offset, output.size())) {
+		std::cerr << "I/O error while reading " << entry.relpath << " from " << m_datfile << std::endl;
+		return false;
+	}
+	dat_cipher(output.data(), output.data(), output.size());
+
+	return true;
+}
+
 bool datafile::extract_one_file(const std::string& filename,
                                 const std::filesystem::path& outfilename,
                                 bool strict_match) const {
@@ -312,56 +530,324 @@ bool datafile::extract_one_file(const std::string& filename,
 		return false;
 	}
 
-	// Extract the file to a buffer (this handles unpacking if m_unpack_on_extract is set)
-	auto file_data = extract_one_file_to_buffer(filename, strict_match);
-	if (file_data.empty()) {
+	const index_entry* file_entry = find_entry(filename, strict_match);
+	if (!file_entry) {
+		std::cout << "Could not find file " << filename << " in catalog\n";
 		return false;
 	}
 
-	// Create directory structure for output file if necessary
-	std::filesystem::path outfile_path(outfilename);
-	std::filesystem::path parent_dir = outfile_path.parent_path();
-	if (!parent_dir.empty()) {
-		std::error_code err;
-		if (!std::filesystem::create_directories(parent_dir, err) && err.value() != 0) {
-			std::cerr << "Failed to create directory " << parent_dir << ": " << err << std::endl;
-			return false;
+	return extract_entry(*file_entry, outfilename);
+}
+
+bool datafile::extract_entry(const index_entry& entry, const std::filesystem::path& outfilename) const {
+	if (outfilename.empty()) {
+		return false;
+	}
+
+	// Creates the directory structure for the output file if necessary
+	std::filesystem::path parent_dir = outfilename.parent_path();
+	output_dir out(parent_dir.empty() ? "." : parent_dir);
+	if (!out.is_open()) {
+		return false;
+	}
+
+	std::vector<uint8_t> buffer;
+	return write_entry(entry, out, outfilename.filename().string(), buffer);
+}
+
+bool datafile::write_entry(const index_entry& entry,
+                           output_dir& out,
+                           std::string_view relpath,
+                           std::vector<uint8_t>& buffer) const {
+	output_file outfile = out.create(relpath);
+	if (!outfile.is_open()) {
+		return false;
+	}
+	auto write_out = [&outfile](const uint8_t* data, size_t size) {
+		return outfile.write(data, size);
+	};
+
+	if (needs_unpack(entry) && entry_is_compressed(entry)) {
+		// Inflate as the data comes in, so the whole entry is never held in memory
+		unpack_stream inflater(write_out);
+		if (stream_entry(entry, buffer, [&inflater](const uint8_t* data, size_t size) {
+			    return inflater.write(data, size);
+		    }) && inflater.finish()) {
+			return close_output(outfile) || discard_output(outfile, out, relpath);
+		}
+
+		// If unpacking failed, write out the original data instead
+		if (!outfile.truncate()) {
+			std::cerr << "Could not rewrite output file " << out.root() / relpath << std::endl;
+			return discard_output(outfile, out, relpath);
 		}
 	}
 
-	// Write to output file
-	std::ofstream outfile(outfilename, std::ios::out | std::ios::binary);
-	if (!outfile) {
-		std::cerr << "Could not open output file " << outfilename << " for writing\n";
+	// The final size is known, so the file can be laid out in one go
+	if (entry.size > SMALL_ENTRY_SIZE) {
+		outfile.preallocate(entry.size);
+	}
+	if (!stream_entry(entry, buffer, write_out) || !close_output(outfile)) {
+		std::cerr << "Error when writing " << out.root() / relpath << std::endl;
+		return discard_output(outfile, out, relpath);
+	}
+	return true;
+}
+
+bool datafile::write_data(const index_entry& entry,
+                          output_dir& out,
+                          std::string_view relpath,
+                          const uint8_t* data,
+                          size_t size) const {
+	output_file outfile = out.create(relpath);
+	if (!outfile.is_open()) {
 		return false;
 	}
-	outfile.write((char*)file_data.data(), file_data.size());
-	outfile.close();
+
+	if (needs_unpack(entry) && is_compressed(data, size)) {
+		unpack_stream inflater([&outfile](const uint8_t* data, size_t size) {
+			return outfile.write(data, size);
+		});
+		if (inflater.write(data, size) && inflater.finish()) {
+			return close_output(outfile) || discard_output(outfile, out, relpath);
+		}
+
+		// If unpacking failed, write out the original data instead
+		if (!outfile.truncate()) {
+			std::cerr << "Could not rewrite output file " << out.root() / relpath << std::endl;
+			return discard_output(outfile, out, relpath);
+		}
+	}
+
+	if (size > SMALL_ENTRY_SIZE) {
+		outfile.preallocate(size);
+	}
+	if (!outfile.write(data, size) || !close_output(outfile)) {
+		std::cerr << "Error when writing " << out.root() / relpath << std::endl;
+		return discard_output(outfile, out, relpath);
+	}
 	return true;
 }
 
-bool datafile::extract(const std::filesystem::path& output_path) const {
-	const std::filesystem::path p(output_path);
+bool datafile::discard_output(output_file& outfile, output_dir& out, std::string_view relpath) const {
+	// Don't leave a truncated or half-written file behind in place of the real one
+	outfile.close();
+	if (!out.remove(relpath)) {
+		std::cerr << "Could not remove incomplete output file " << out.root() / relpath << std::endl;
+	}
+	return false;
+}
 
-	for (const auto& entry : m_index) {
-		std::filesystem::path entry_path = p / entry.relpath;
-		std::filesystem::path out_path = entry_path.parent_path();
+bool datafile::close_output(output_file& outfile) const {
+	if (m_drop_cache) {
+		outfile.drop_cache();
+	}
+	return outfile.close();
+}
 
-		std::error_code err;
-		if (!std::filesystem::create_directories(out_path, err) && err.value() != 0) {
-			std::cerr << "Failed to create directory " << out_path << ": " << err << std::endl;
+void datafile::drop_input(uint64_t offset, uint64_t len) const {
+	if (!m_drop_cache) {
+		return;
+	}
+	if (m_datmap.is_open()) {
+		// Pages that are still mapped stay in the page cache whatever it's told
+		m_datmap.dont_need(offset, len);
+	}
+	m_datreader.dont_need(offset, len);
+}
+
+void datafile::prefetch(std::span<const index_entry* const> run) const {
+	if (!run.empty() && !m_datmap.is_open()) {
+		uint64_t start = run.front()->offset;
+		m_datreader.will_need(start, run.back()->offset + run.back()->size - start);
+	}
+}
+
+std::vector<work_range> datafile::coalesce(std::span<const index_entry* const> entries, uint64_t limit) {
+	std::vector<work_range> runs;
+	uint64_t run_end = 0; // Where the last run ends in the .dat file
+	uint64_t run_size = 0;
+	bool extendable = false; // Whether the last run is all small entries, so it can take more
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const index_entry& entry = *entries[i];
+		bool small = entry.size <= SMALL_ENTRY_SIZE;
+		if (small && extendable && entry.offset == run_end && run_size + entry.size <= limit) {
+			runs.back().second = i + 1;
+			run_size += entry.size;
+		} else {
+			runs.emplace_back(i, i + 1);
+			run_size = entry.size;
+			extendable = small;
+		}
+		run_end = entry.offset + entry.size;
+	}
+	return runs;
+}
+
+bool datafile::extract_run(std::span<const index_entry* const> run,
+                           output_dir& out,
+                           std::vector<uint8_t>& buffer) const {
+	if (run.size() == 1) {
+		if (!write_entry(*run[0], out, run[0]->relpath, buffer)) {
+			std::cerr << "Error when extracting " << run[0]->relpath << std::endl;
 			return false;
 		}
+		return true;
+	}
 
-		if (!extract_one_file(entry.relpath, entry_path)) {
-			std::cerr << "Error when extracting " << entry.relpath << std::endl;
+	// One read and one pass of the cipher over the whole run
+	uint64_t start = run.front()->offset;
+	uint64_t len = run.back()->offset + run.back()->size - start;
+	buffer.resize(len);
+	if (m_datmap.is_open()) {
+		auto encoded = m_datmap.view(start, len);
+		if (encoded.size() != len) {
+			std::cerr << "Entry " << run.back()->relpath << " lies outside of " << m_datfile << std::endl;
+			return false;
+		}
+		dat_cipher(encoded.data(), buffer.data(), len);
+	} else {
+		if (!m_datreader.read_at(buffer.data(), start, len)) {
+			std::cerr << "I/O error while reading " << run.front()->relpath << " to " << run.back()->relpath
+			          << " from " << m_datfile << std::endl;
+			return false;
+		}
+		dat_cipher(buffer.data(), buffer.data(), len);
+	}
+	drop_input(start, len);
+
+	for (const index_entry* entry : run) {
+		if (!write_data(*entry, out, entry->relpath, buffer.data() + (entry->offset - start), entry->size)) {
+			std::cerr << "Error when extracting " << entry->relpath << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool datafile::stream_entry(const index_entry& entry,
+                            std::vector<uint8_t>& buffer,
+                            const std::function<bool(const uint8_t*, size_t)>& sink) const {
+	std::span<const uint8_t> encoded;
+	if (m_datmap.is_open()) {
+		encoded = get_entry_view(entry);
+		if (encoded.size() != entry.size) {
+			std::cerr << "Entry " << entry.relpath << " lies outside of " << m_datfile << std::endl;
+			return false;
+		}
+	}
+
+	buffer.resize(std::max<size_t>(1, std::min<uint64_t>(m_buffer_size, entry.size)));
+	for (uint64_t pos = 0; pos < entry.size; pos += buffer.size()) {
+		size_t len = std::min<uint64_t>(buffer.size(), entry.size - pos);
+
+		if (m_datmap.is_open()) {
+			dat_cipher(encoded.data() + pos, buffer.data(), len);
+		} else {
+			if (!m_datreader.read_at(buffer.data(), entry.offset + pos, len)) {
+				std::cerr << "I/O error while reading " << entry.relpath << " from " << m_datfile << std::endl;
+				return false;
+			}
+			dat_cipher(buffer.data(), buffer.data(), len);
+		}
+
+		if (!sink(buffer.data(), len)) {
 			return false;
 		}
 	}
 
+	drop_input(entry.offset, entry.size);
 	return true;
 }
 
+bool datafile::entry_is_compressed(const index_entry& entry) const {
+	uint8_t magic[2];
+	if (entry.size < sizeof(magic)) {
+		return false;
+	}
+
+	if (m_datmap.is_open()) {
+		auto encoded = m_datmap.view(entry.offset, sizeof(magic));
+		if (encoded.size() != sizeof(magic)) {
+			return false;
+		}
+		dat_cipher(encoded.data(), magic, sizeof(magic));
+	} else {
+		if (!m_datreader.read_at(magic, entry.offset, sizeof(magic))) {
+			return false;
+		}
+		dat_cipher(magic, magic, sizeof(magic));
+	}
+	return is_compressed(magic, sizeof(magic));
+}
+
+bool datafile::extract(const std::filesystem::path& output_path, unsigned jobs) const {
+	// Directories are made as files need them, once each
+	output_dir out(output_path);
+	if (!out.is_open()) {
+		return false;
+	}
+
+	// The index is in .dat order, so neighbouring entries are next to each other on disk
+	std::vector<const index_entry*> entries;
+	entries.reserve(m_index.size());
+	for (const auto& entry : m_index) {
+		entries.push_back(&entry);
+	}
+	std::vector<work_range> runs = coalesce(entries, coalesce_limit());
+
+	// Hand out the biggest runs first, so that no worker picks up a huge one right at the end
+	if (jobs > 1) {
+		auto run_size = [&entries](const work_range& r) {
+			return entries[r.second - 1]->offset + entries[r.second - 1]->size - entries[r.first]->offset;
+		};
+		std::stable_sort(runs.begin(), runs.end(), [&run_size](const work_range& a, const work_range& b) {
+			return run_size(a) > run_size(b);
+		});
+	}
+
+	// The runs are mostly read front to back, so the kernel can read further ahead than usual
+	if (!m_datmap.is_open()) {
+		m_datreader.advise(ACCESS_SEQUENTIAL);
+	}
+
+	auto get_run = [&entries, &runs](size_t idx) {
+		return std::span<const index_entry* const>(entries.data() + runs[idx].first,
+		                                           runs[idx].second - runs[idx].first);
+	};
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	run_workers(std::max(1u, std::min<unsigned>(jobs, runs.size())), [&](unsigned) {
+		std::vector<uint8_t> buffer;
+		std::unique_ptr<uring_extractor> ring;
+		if (m_use_io_uring) {
+			ring = std::make_unique<uring_extractor>(out, coalesce_limit());
+		}
+
+		while (!failed) {
+			size_t idx = next++;
+			if (idx >= runs.size()) {
+				break;
+			}
+
+			// Have the next run on its way from the disk while this one is written out
+			if (idx + 1 < runs.size()) {
+				prefetch(get_run(idx + 1));
+			}
+			std::span<const index_entry* const> run = get_run(idx);
+			if (!(ring ? ring->add(*this, run) : extract_run(run, out, buffer))) {
+				failed = true;
+			}
+		}
+		if (ring && !ring->finish()) {
+			failed = true;
+		}
+	});
+
+	return !failed;
+}
+
 void datafile::set_datafile(const std::string& datafile) {
 	std::filesystem::path cfpath(m_catfile);
 	// For some reason, 13.cat has a bogus datafile. How does the game even load it?
@@ -377,4 +863,6 @@ void datafile::set_datafile(const std::string& datafile) {
 	} else {
 		m_datfile = datafile;
 	}
+
+	m_datreader.reset(m_datfile);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <list>
 #include <set>
 #include <cstdint>
@@ -11,6 +13,16 @@
 #include <iomanip>
 #include <memory>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <span>
+
+#include "bloom_filter.h"
+#include "file_reader.h"
+#include "mapped_file.h"
+#include "output_dir.h"
+#include "parallel.h"
 
 /**
  * Represents a single cat / dat pair.
@@ -18,10 +30,35 @@
  * The .cat file is the index (catalog) of the contents of the .dat file. This
  * class manages the pair as a unit, providing functions to inspect, decode,
  * and build these data files and corresponding catalogs.
+ *
+ * Once a catalog is parsed, the const functions may be called from several
+ * threads at once.
  */
 class datafile {
 public:
+	/**
+	 * Represents one entry in the .cat file.
+	 *
+	 * relpath points into the decrypted catalog owned by the datafile, so an
+	 * entry is only valid as long as the datafile it came from.
+	 */
+	struct index_entry {
+		std::string_view relpath;
+		uint64_t offset;
+		uint64_t size;
+
+		index_entry(std::string_view path, uint64_t file_offset, uint64_t file_size)
+			: relpath(path), offset(file_offset), size(file_size) {}
+
+		bool operator==(std::string_view str) const { return relpath == str; }
+	};
+
 	datafile() {}
+	// The index refers into m_unencrypted_cat, which survives a move but not a copy
+	datafile(datafile&&) = default;
+	datafile& operator=(datafile&&) = default;
+	datafile(const datafile&) = delete;
+	datafile& operator=(const datafile&) = delete;
 	datafile(const std::filesystem::path& catfilename) {
 		if (parse(catfilename)) {
 			m_catfile = catfilename.string();
@@ -30,8 +67,23 @@ public:
 
 	/**
 	 * Given a .cat file, decrypt it and store the file list.
+	 * If this fails, the datafile is left empty, whatever it held before.
+	 * With compact set, the result is the same as calling compact() afterwards, only cheaper.
+	 */
+	bool parse(const std::filesystem::path& catfilename, bool compact = false);
+
+	/**
+	 * Set up a compact datafile from an index that was saved earlier, without reading the
+	 * catalog itself. paths holds every entry's path back to back, in catalog order, and
+	 * header is the first line of the catalog.
+	 *
+	 * Returns false if the path lengths don't fit in paths, leaving the datafile empty.
 	 */
-	bool parse(const std::filesystem::path& catfilename);
+	bool load_compact(const std::filesystem::path& catfilename,
+	                  const std::string& header,
+	                  std::string_view paths,
+	                  std::span<const uint64_t> sizes,
+	                  std::span<const uint32_t> path_lengths);
 
 	/**
 	 * Build a .cat and .dat file from a directory.
@@ -45,9 +97,23 @@ public:
 
 	/**
 	 * Write out a decrypted version of the catalog file.
+	 *
+	 * After compact(), the text is regenerated from the index. For a well-formed
+	 * catalog this is the same as the original.
 	 */
 	bool decrypt_to_file(const std::filesystem::path& filename) const;
 
+	/**
+	 * Drop the decrypted catalog text, keeping only the paths the index refers to.
+	 * Use this when the catalog is only going to be used for lookups and extraction.
+	 */
+	void compact();
+
+	/**
+	 * Whether compact() has been called since the catalog was parsed.
+	 */
+	bool is_compact() const { return m_compact; }
+
 	/**
 	 * Decrypt a single file from the data file.
 	 */
@@ -61,10 +127,74 @@ public:
 	 */
 	std::vector<uint8_t> extract_one_file_to_buffer(const std::string& filename, bool strict_match = false) const;
 
+	/**
+	 * Decrypt an entry previously returned by find_entry to a file.
+	 */
+	bool extract_entry(const index_entry& entry, const std::filesystem::path& outfilename) const;
+
+	/**
+	 * Decrypt an entry previously returned by find_entry to a memory buffer.
+	 */
+	std::vector<uint8_t> extract_entry_to_buffer(const index_entry& entry) const;
+
+	/**
+	 * Map the .dat file into memory, so extraction reads from the mapping instead of opening the file each time.
+	 * The pattern is passed to the kernel as a paging hint.
+	 */
+	bool map_datfile(access_pattern pattern = ACCESS_SEQUENTIAL);
+
+	/**
+	 * Whether the .dat file is currently mapped.
+	 */
+	bool is_datfile_mapped() const { return m_datmap.is_open(); }
+
+	/**
+	 * Get the still-encoded bytes of an entry from the mapped .dat file, without copying them.
+	 * Returns an empty span if the .dat file is not mapped or the entry does not fit in it.
+	 */
+	std::span<const uint8_t> get_entry_view(const index_entry& entry) const;
+
+	/**
+	 * Split entries into runs that extract_run() can read in one go: small entries that
+	 * follow each other directly in the .dat file, up to limit bytes in all (normally
+	 * coalesce_limit()). Any other entry is a run of its own. Returns the [first, last)
+	 * indexes of each run.
+	 */
+	static std::vector<work_range> coalesce(std::span<const index_entry* const> entries,
+	                                        uint64_t limit = COALESCE_SIZE);
+
+	/**
+	 * How much extract() reads at once when it coalesces entries: the buffer size, but at least
+	 * SMALL_ENTRY_SIZE and at most COALESCE_SIZE.
+	 */
+	uint64_t coalesce_limit() const {
+		return std::clamp<uint64_t>(m_buffer_size, SMALL_ENTRY_SIZE, COALESCE_SIZE);
+	}
+
+	/**
+	 * Extract a run of entries from coalesce() into out, each at its own path. A run of
+	 * several entries is read and decoded as one block and then split up, so it costs one
+	 * read however many files are in it.
+	 */
+	bool extract_run(std::span<const index_entry* const> run, output_dir& out, std::vector<uint8_t>& buffer) const;
+
+	/**
+	 * Start reading a run from coalesce() into the page cache, ahead of extract_run().
+	 */
+	void prefetch(std::span<const index_entry* const> run) const;
+
+	/** Entries up to this size are read together with their neighbours by extract_run() */
+	static constexpr uint64_t SMALL_ENTRY_SIZE = 64 * 1024;
+	/** Most that extract_run() ever reads at once, whatever the buffer size */
+	static constexpr uint64_t COALESCE_SIZE = 4 * 1024 * 1024;
+
 	/**
 	 * Decrypt every file in the data file into a filesystem hierarchy.
+	 *
+	 * Runs of small files are read in blocks; see extract_run(). With jobs > 1, the runs are
+	 * extracted by that many worker threads, largest first.
 	 */
-	bool extract(const std::filesystem::path& output_path) const;
+	bool extract(const std::filesystem::path& output_path, unsigned jobs = 1) const;
 
 	/**
 	 * Gets the name of the .dat file associated with this data pair.
@@ -76,6 +206,11 @@ public:
 	 */
 	const std::string& get_catfile_name() const { return m_catfile; }
 
+	/**
+	 * Gets the first line of the catalog, which names the .dat file as the catalog wrote it.
+	 */
+	const std::string& get_cat_header() const { return m_cat_header; }
+
 	/**
 	 * Get a list of file paths inside that data file.
 	 */
@@ -83,28 +218,66 @@ public:
 		std::list<std::string> ret;
 
 		for (const auto& entry : m_index) {
-			ret.push_back(entry.relpath);
+			ret.emplace_back(entry.relpath);
 		}
 
 		return ret;
 	}
 
+	/**
+	 * Get every entry in the index, in catalog order.
+	 */
+	const std::vector<index_entry>& get_entries() const { return m_index; }
+
+	/**
+	 * The filename portion of a path inside a catalog, which always uses '/' as the separator.
+	 */
+	static std::string_view filename_part(std::string_view relpath);
+
+	/**
+	 * Look up an entry in the index.
+	 *
+	 * With strict_match, the full relative path must match. Otherwise only the
+	 * filename is compared, and the first entry in catalog order wins.
+	 * Returns nullptr if there is no such entry.
+	 */
+	const index_entry* find_entry(std::string_view filename, bool strict_match = false) const;
+
+	/**
+	 * Match paths the way the game does: ignoring case, and treating '\\' the same as '/'.
+	 * This keeps a normalized copy of the paths to index, so it costs some memory.
+	 */
+	void set_ignore_case(bool enable = true);
+	bool get_ignore_case() const { return m_ignore_case; }
+
+	/**
+	 * The key an entry is indexed under: its path, normalized if set_ignore_case() is on.
+	 */
+	std::string_view get_key(const index_entry& entry) const;
+
+	/**
+	 * Lower-case ASCII letters and turn '\\' into '/', which is how the game compares paths.
+	 * dst may be the same as src.
+	 */
+	static void normalize_path(const char* src, char* dst, size_t len);
+	static std::string normalize_path(std::string_view path);
+
+	/**
+	 * Bloom filter over every path and filename in the index, normalized.
+	 */
+	const bloom_filter& get_bloom() const { return m_bloom; }
+
+	/**
+	 * Check a datafile's Bloom filter for a file, using the same matching rules as find_entry().
+	 * False means the datafile definitely doesn't have it.
+	 */
+	static bool may_contain(const bloom_filter& filter, std::string_view filename, bool strict_match);
+
 	/**
 	 * Check if this datafile contains a file with the given name.
 	 */
 	bool has_file(const std::string& filename, bool strict_match = false) const {
-		for (const auto& entry : m_index) {
-			if (strict_match) {
-				if (entry == filename) {
-					return true;
-				}
-			} else {
-				if (entry.filename_match(filename)) {
-					return true;
-				}
-			}
-		}
-		return false;
+		return find_entry(filename, strict_match) != nullptr;
 	}
 
 	/**
@@ -112,35 +285,32 @@ public:
 	 */
 	void unpack_on_extract(bool enable = true) { m_unpack_on_extract = enable; }
 
-private:
 	/**
-	 * Represents one entry in the .cat file
+	 * Set the size of the blocks files are streamed in when extracting to disk.
+	 * This bounds the memory used per file, however large the file is. Runs of small
+	 * files are read in blocks of up to this size too, but never less than SMALL_ENTRY_SIZE.
 	 */
-	struct index_entry {
-		std::string relpath;
-		uint32_t offset;
-		uint32_t size;
-
-		/**
-		 * Read one index entry given a line in the index file.
-		 * An entry looks like:
-		 * <filename> <size>
-		 */
-		index_entry(const char* line, uint32_t delim_offset, uint32_t len, uint32_t file_offset)
-			: relpath(line, delim_offset), offset(file_offset) {
-			std::string sizestr(&line[delim_offset + 1], len - delim_offset);
-			std::stringstream ss(sizestr);
-			ss >> size;
-		}
+	void set_buffer_size(size_t bytes) { m_buffer_size = std::max<size_t>(bytes, 1); }
+
+	/**
+	 * Extract through io_uring where the kernel has it, falling back to ordinary reads and
+	 * writes where it doesn't. See uring_extractor.
+	 */
+	void use_io_uring(bool enable = true) { m_use_io_uring = enable; }
 
-		bool operator==(const std::string& str) const { return relpath == str; }
+	/**
+	 * Drop what extraction reads and writes from the page cache as it goes, so that
+	 * extracting a lot of data doesn't push everything else out of memory. This makes
+	 * extraction wait for each file to reach the disk.
+	 */
+	void drop_cache_after_extract(bool enable = true) { m_drop_cache = enable; }
 
-		bool filename_match(const std::string& filename) const {
-			std::filesystem::path entry_path(relpath);
-			std::filesystem::path target_path(filename);
-			return entry_path.filename() == target_path.filename();
-		}
-	};
+	/** Default for set_buffer_size */
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 1024 * 1024; // 1 MB
+
+private:
+	// Reads the .dat file itself and writes out what it read with write_data()
+	friend class uring_extractor;
 
 	void set_datafile(const std::string& datafile);
 
@@ -149,8 +319,85 @@ private:
 	std::string m_catfile;
 	std::string m_datfile;
 
-	std::list<index_entry> m_index;
+	/**
+	 * Build the lookup tables over m_index, and the Bloom filter too unless bloom is false.
+	 * The filter doesn't refer to the catalog buffer, so it survives the paths moving.
+	 */
+	void build_lookup(bool bloom = true);
+
+	/**
+	 * Move the paths to the front of the catalog buffer and free the rest of it.
+	 * The lookup tables refer to the old places, so they have to be built again after this.
+	 */
+	void pack_paths();
+
+	/**
+	 * Forget the parsed catalog, after a parse that failed part way through.
+	 */
+	void clear_index();
+
+	bool needs_unpack(const index_entry& entry) const;
+	bool read_entry(const index_entry& entry, std::vector<uint8_t>& output) const;
+	bool entry_is_compressed(const index_entry& entry) const;
+
+	/**
+	 * Extract an entry to relpath under out, using buffer for the stream blocks.
+	 */
+	bool write_entry(const index_entry& entry,
+	                 output_dir& out,
+	                 std::string_view relpath,
+	                 std::vector<uint8_t>& buffer) const;
+
+	/**
+	 * Write an entry that has already been read and decoded to relpath under out, unpacking it if needed.
+	 */
+	bool write_data(const index_entry& entry,
+	                output_dir& out,
+	                std::string_view relpath,
+	                const uint8_t* data,
+	                size_t size) const;
+
+	/**
+	 * Close a file that has been extracted, dropping it from the page cache first if asked to.
+	 */
+	bool close_output(output_file& outfile) const;
+
+	/**
+	 * Close and delete an output file that couldn't be written in full. Always returns false.
+	 */
+	bool discard_output(output_file& outfile, output_dir& out, std::string_view relpath) const;
+
+	/**
+	 * Drop a range of the .dat file that has been read from the page cache, if asked to.
+	 */
+	void drop_input(uint64_t offset, uint64_t len) const;
+
+	/**
+	 * Read an entry in blocks of up to m_buffer_size bytes, decode each one and hand it to sink.
+	 * The buffer is resized as needed, so it can be reused from one call to the next.
+	 */
+	bool stream_entry(const index_entry& entry,
+	                  std::vector<uint8_t>& buffer,
+	                  const std::function<bool(const uint8_t*, size_t)>& sink) const;
+
+	std::vector<index_entry> m_index;
+	// Lookup tables into m_index, keyed by full relative path and by filename only
+	std::unordered_map<std::string_view, size_t> m_path_lookup;
+	std::unordered_map<std::string_view, size_t> m_name_lookup;
+	bloom_filter m_bloom;
+	// Normalized copy of m_unencrypted_cat that the lookup tables are keyed on, with set_ignore_case()
+	bool m_ignore_case = false;
+	std::vector<char> m_keys;
+	// The decrypted catalog, or just the packed paths after compact()
 	std::vector<uint8_t> m_unencrypted_cat;
+	std::string m_cat_header;
+	bool m_compact = false;
+	// Opened on first use and shared by every reader, so extraction can run on several threads
+	file_reader m_datreader;
+	mapped_file m_datmap;
 
 	bool m_unpack_on_extract = false;
+	bool m_use_io_uring = false;
+	bool m_drop_cache = false;
+	size_t m_buffer_size = DEFAULT_BUFFER_SIZE;
 };
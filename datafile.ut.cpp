@@ -1,10 +1,14 @@
 #include "datafile.h"
+#include "cipher.h"
+#include "pck.h"
 #include "test_utils.h"
 
 #include <fstream>
 #include <string>
 #include <list>
 #include <filesystem>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
 static const std::string TEST_DIR = "test";
@@ -36,6 +40,13 @@ static void cleanup_test_dir() {
 }
 
 
+// Write a catalog with the given text, encrypted the way the game expects
+static void write_cat(const std::string& path, std::string text) {
+	cat_cipher((const uint8_t*)text.data(), (uint8_t*)text.data(), text.size());
+	std::ofstream out(path, std::ios::out | std::ios::binary);
+	out.write(text.data(), text.size());
+}
+
 // Test fixture that sets up and tears down the test directory
 class datafile_tests : public ::testing::Test {
 protected:
@@ -92,6 +103,19 @@ TEST_F(datafile_tests, parse_path_with_spaces) {
 	ASSERT_EQ("testdir/testfile3.new", list.front());
 }
 
+TEST_F(datafile_tests, move_keeps_index) {
+	datafile original(TEST_CAT);
+	datafile df(std::move(original));
+
+	// Entry paths point into the catalog buffer, which must have moved along with them
+	auto entry = df.find_entry("testdir/testfile2.ext", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("testdir/testfile2.ext", entry->relpath);
+	ASSERT_EQ(1616u, entry->offset);
+	ASSERT_EQ(256u, entry->size);
+	ASSERT_EQ(6u, df.get_file_list().size());
+}
+
 TEST_F(datafile_tests, listing) {
 	datafile df(TEST_CAT);
 
@@ -120,6 +144,58 @@ TEST_F(datafile_tests, decrypt) {
 	ASSERT_EQ(expected, test_utils::read_file(TEST_DIR + "/testcat.out"));
 }
 
+TEST_F(datafile_tests, compact) {
+	datafile df(TEST_CAT);
+	df.compact();
+	ASSERT_TRUE(df.is_compact());
+
+	// Lookups still work off the packed paths
+	auto entry = df.find_entry("testdir/testfile2.ext", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("testdir/testfile2.ext", entry->relpath);
+	ASSERT_EQ(1616u, entry->offset);
+	ASSERT_TRUE(df.find_entry("zzz has spaces", false));
+	ASSERT_EQ(6u, df.get_file_list().size());
+
+	ASSERT_TRUE(df.extract_one_file("testdir/testfile3.new", TEST_DIR + "/compact.out"));
+	ASSERT_EQ(1u, std::filesystem::file_size(TEST_DIR + "/compact.out"));
+}
+
+TEST_F(datafile_tests, parse_compact) {
+	datafile full(TEST_CAT);
+	datafile df;
+	ASSERT_TRUE(df.parse(TEST_CAT, true));
+	ASSERT_TRUE(df.is_compact());
+	ASSERT_EQ(full.get_index_listing(), df.get_index_listing());
+
+	auto entry = df.find_entry("testdir/testfile2.ext", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ(1616u, entry->offset);
+	ASSERT_TRUE(df.find_entry("zzz has spaces", false));
+	ASSERT_TRUE(datafile::may_contain(df.get_bloom(), "testdir/testfile2.ext", true));
+
+	// Switching case sensitivity afterwards keeps both the lookups and the filter working
+	df.set_ignore_case(true);
+	ASSERT_EQ(entry, df.find_entry("TESTDIR\\TestFile2.ext", true));
+	ASSERT_TRUE(datafile::may_contain(df.get_bloom(), "TESTDIR\\TestFile2.ext", true));
+
+	df.decrypt_to_file(TEST_DIR + "/parse_compact.out");
+	full.decrypt_to_file(TEST_DIR + "/parse_full.out");
+	ASSERT_EQ(test_utils::read_file(TEST_DIR + "/parse_full.out"),
+	          test_utils::read_file(TEST_DIR + "/parse_compact.out"));
+}
+
+TEST_F(datafile_tests, decrypt_compact) {
+	datafile df(TEST_CAT);
+	df.decrypt_to_file(TEST_DIR + "/testcat.out");
+	std::string expected = test_utils::read_file(TEST_DIR + "/testcat.out");
+
+	// The regenerated text should match the original
+	df.compact();
+	ASSERT_TRUE(df.decrypt_to_file(TEST_DIR + "/testcat_compact.out"));
+	ASSERT_EQ(expected, test_utils::read_file(TEST_DIR + "/testcat_compact.out"));
+}
+
 TEST_F(datafile_tests, extract_by_filename_only) {
 	datafile df(TEST_CAT);
 
@@ -196,6 +272,416 @@ TEST_F(datafile_tests, extract_archive) {
 	// Verify file with spaces
 	content = test_utils::read_file(extract_dir + "/spaces in dir/spaces in file");
 	ASSERT_EQ("576,16,", content.substr(0, 7));
+
+	// A file sharing its name with an earlier entry must still get its own contents
+	content = test_utils::read_file(extract_dir + "/testdir/testfile.ext");
+	ASSERT_EQ("592,1024,", content.substr(0, 9));
+}
+
+TEST_F(datafile_tests, find_entry_strict) {
+	datafile df(TEST_CAT);
+
+	auto entry = df.find_entry("testdir/testfile.ext", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("testdir/testfile.ext", entry->relpath);
+	ASSERT_EQ(592u, entry->offset);
+	ASSERT_EQ(1024u, entry->size);
+
+	// Strict lookups need the whole path
+	ASSERT_FALSE(df.find_entry("testfile.ext", true));
+	ASSERT_FALSE(df.find_entry("wrongdir/testfile.ext", true));
+}
+
+TEST_F(datafile_tests, bloom_filter) {
+	datafile df(TEST_CAT);
+
+	for (const auto& path : df.get_file_list()) {
+		ASSERT_TRUE(datafile::may_contain(df.get_bloom(), path, true));
+		ASSERT_TRUE(datafile::may_contain(df.get_bloom(), "elsewhere/" + path, false));
+	}
+	ASSERT_FALSE(datafile::may_contain(df.get_bloom(), "not/in/the/catalog.txt", true));
+}
+
+TEST_F(datafile_tests, find_entry_ignore_case) {
+	datafile df(TEST_CAT);
+	ASSERT_FALSE(df.find_entry("TestDir/TestFile2.EXT", true));
+
+	df.set_ignore_case();
+	auto entry = df.find_entry("TestDir\\TestFile2.EXT", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("testdir/testfile2.ext", entry->relpath);
+	ASSERT_TRUE(df.find_entry("SPACES IN FILE", false));
+	ASSERT_FALSE(df.find_entry("testdir/testfile2.ex", true));
+
+	// Still works once the buffer has been compacted
+	df.compact();
+	entry = df.find_entry("OTHERDIR/ZZZ HAS SPACES", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("otherdir/zzz has spaces", entry->relpath);
+
+	df.set_ignore_case(false);
+	ASSERT_FALSE(df.find_entry("OTHERDIR/ZZZ HAS SPACES", true));
+	ASSERT_TRUE(df.find_entry("otherdir/zzz has spaces", true));
+}
+
+TEST_F(datafile_tests, normalize_path) {
+	ASSERT_EQ("a/b/c_d-e.txt", datafile::normalize_path("A\\b/C_d-E.TXT"));
+	// Only ASCII letters change
+	ASSERT_EQ("[@`{]\xc3\x89", datafile::normalize_path("[@`{]\xc3\x89"));
+}
+
+TEST_F(datafile_tests, find_entry_by_filename) {
+	datafile df(TEST_CAT);
+
+	// The first entry in catalog order wins when names are ambiguous
+	auto entry = df.find_entry("testfile.ext", false);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("otherdir/testfile.ext", entry->relpath);
+
+	// Any directory part of the query is ignored
+	entry = df.find_entry("wrongdir/testfile3.new", false);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ("testdir/testfile3.new", entry->relpath);
+
+	ASSERT_FALSE(df.find_entry("nonexistent.txt", false));
+	ASSERT_TRUE(df.has_file("zzz has spaces"));
+	ASSERT_FALSE(df.has_file("zzz has spaces", true));
+}
+
+TEST_F(datafile_tests, mapped_entry_view) {
+	datafile df(TEST_CAT);
+	auto entry = df.find_entry("testdir/testfile3.new", true);
+	ASSERT_TRUE(entry);
+
+	// Nothing to view until the .dat file is mapped
+	ASSERT_FALSE(df.is_datfile_mapped());
+	ASSERT_TRUE(df.get_entry_view(*entry).empty());
+
+	ASSERT_TRUE(df.map_datfile(ACCESS_RANDOM));
+	ASSERT_TRUE(df.is_datfile_mapped());
+	auto view = df.get_entry_view(*entry);
+	ASSERT_EQ(1u, view.size());
+	// The view is still encoded
+	ASSERT_EQ('1' ^ 0x33, view[0]);
+}
+
+TEST_F(datafile_tests, mapped_extract_matches_unmapped) {
+	datafile plain(TEST_CAT);
+	datafile mapped(TEST_CAT);
+	ASSERT_TRUE(mapped.map_datfile());
+
+	for (const auto& name : plain.get_file_list()) {
+		ASSERT_EQ(plain.extract_one_file_to_buffer(name, true), mapped.extract_one_file_to_buffer(name, true)) << name;
+	}
+
+	std::string extract_dir = TEST_DIR + "/test_extract_mapped";
+	ASSERT_TRUE(mapped.extract(extract_dir));
+	ASSERT_EQ("1", test_utils::read_file(extract_dir + "/testdir/testfile3.new"));
+	ASSERT_EQ("592,1024,", test_utils::read_file(extract_dir + "/testdir/testfile.ext").substr(0, 9));
+	ASSERT_EQ(1024u, std::filesystem::file_size(extract_dir + "/testdir/testfile.ext"));
+}
+
+TEST_F(datafile_tests, map_missing_datfile) {
+	datafile df;
+	ASSERT_FALSE(df.map_datfile());
+	ASSERT_FALSE(df.is_datfile_mapped());
+}
+
+TEST_F(datafile_tests, extract_concurrently) {
+	datafile df(TEST_CAT);
+	auto names = df.get_file_list();
+
+	// Every thread reads every entry through the same datafile
+	std::vector<std::thread> threads;
+	std::vector<int> failures(8, 0);
+	for (size_t t = 0; t < failures.size(); ++t) {
+		threads.emplace_back([&, t] {
+			for (int round = 0; round < 20; ++round) {
+				for (const auto& name : names) {
+					auto entry = df.find_entry(name, true);
+					auto data = df.extract_entry_to_buffer(*entry);
+					if (data.size() != entry->size) {
+						failures[t]++;
+					}
+				}
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	for (int f : failures) {
+		ASSERT_EQ(0, f);
+	}
+	ASSERT_EQ("592,1024,", std::string((char*)df.extract_one_file_to_buffer("testdir/testfile.ext", true).data(), 9));
+}
+
+TEST_F(datafile_tests, extract_missing_datfile) {
+	std::filesystem::path dir = std::filesystem::path(TEST_DIR) / "path with spaces";
+	datafile df(dir / "test.cat");
+	std::filesystem::remove(dir / "test.dat");
+
+	ASSERT_TRUE(df.has_file("testfile3.new"));
+	ASSERT_TRUE(df.extract_one_file_to_buffer("testfile3.new").empty());
+	ASSERT_FALSE(df.extract_one_file("testfile3.new", TEST_DIR + "/missing_dat.out"));
+}
+
+TEST_F(datafile_tests, extract_small_buffer) {
+	datafile df(TEST_CAT);
+	// Much smaller than the entries, and not a divisor of any of them
+	df.set_buffer_size(7);
+
+	std::string extract_dir = TEST_DIR + "/test_extract_small_buffer";
+	ASSERT_TRUE(df.extract(extract_dir));
+
+	for (const auto& name : df.get_file_list()) {
+		auto expected = df.extract_one_file_to_buffer(name, true);
+		ASSERT_EQ(std::string(expected.begin(), expected.end()), test_utils::read_file(extract_dir + "/" + name))
+			<< name;
+	}
+}
+
+TEST_F(datafile_tests, extract_pck_streaming) {
+	std::string build_dir = TEST_DIR + "/test_pck_src";
+	std::filesystem::create_directories(build_dir + "/types");
+
+	// A compressed file much bigger than the stream buffer, a .pck that isn't compressed,
+	// and one that claims to be compressed but isn't valid gzip
+	std::string original;
+	for (int i = 0; i < 20000; ++i) {
+		original += "line " + std::to_string(i) + "\n";
+	}
+	auto packed = pack(std::vector<uint8_t>(original.begin(), original.end()));
+	{
+		std::ofstream f(build_dir + "/types/big.pck", std::ios::binary);
+		f.write((const char*)packed.data(), packed.size());
+		std::ofstream plain(build_dir + "/types/plain.pck", std::ios::binary);
+		plain << "not compressed";
+		std::ofstream broken(build_dir + "/types/broken.pck", std::ios::binary);
+		broken << "\x1f\x8bnot really gzip";
+	}
+
+	datafile builder;
+	ASSERT_TRUE(builder.build(build_dir, TEST_DIR + "/pck.cat"));
+
+	for (bool mapped : {false, true}) {
+		datafile df(TEST_DIR + "/pck.cat");
+		df.unpack_on_extract(true);
+		df.set_buffer_size(1000);
+		if (mapped) {
+			ASSERT_TRUE(df.map_datfile());
+		}
+
+		std::string extract_dir = TEST_DIR + "/test_pck_out" + (mapped ? "_mapped" : "");
+		ASSERT_TRUE(df.extract(extract_dir));
+		ASSERT_EQ(original, test_utils::read_file(extract_dir + "/types/big.pck"));
+		ASSERT_EQ("not compressed", test_utils::read_file(extract_dir + "/types/plain.pck"));
+		ASSERT_EQ("\x1f\x8bnot really gzip", test_utils::read_file(extract_dir + "/types/broken.pck"));
+	}
+}
+
+TEST_F(datafile_tests, extract_archive_parallel) {
+	datafile df(TEST_CAT);
+	df.set_buffer_size(100);
+
+	// More workers than files is fine too
+	for (unsigned jobs : {2u, 4u, 16u}) {
+		std::string extract_dir = TEST_DIR + "/test_extract_jobs" + std::to_string(jobs);
+		ASSERT_TRUE(df.extract(extract_dir, jobs));
+
+		for (const auto& name : df.get_file_list()) {
+			auto expected = df.extract_one_file_to_buffer(name, true);
+			ASSERT_EQ(std::string(expected.begin(), expected.end()), test_utils::read_file(extract_dir + "/" + name))
+				<< name << " with " << jobs << " jobs";
+		}
+	}
+}
+
+TEST_F(datafile_tests, coalesce) {
+	using runs = std::vector<work_range>;
+	const uint64_t big = datafile::SMALL_ENTRY_SIZE + 1;
+	std::vector<datafile::index_entry> index = {
+		{"a", 0, 10}, {"b", 10, 0}, {"c", 10, 20},   // Back to back
+		{"d", 30, big},                               // Too big to share a read
+		{"e", 30 + big, 5}, {"f", 30 + big + 5, 5},   // Back to back again
+		{"g", 100 + big, 5},                          // A gap before it
+	};
+	std::vector<const datafile::index_entry*> entries;
+	for (const auto& entry : index) {
+		entries.push_back(&entry);
+	}
+	ASSERT_EQ(runs({{0, 3}, {3, 4}, {4, 6}, {6, 7}}), datafile::coalesce(entries));
+
+	// Runs stop growing at COALESCE_SIZE
+	index.clear();
+	const uint64_t size = datafile::SMALL_ENTRY_SIZE;
+	for (uint64_t i = 0; i < datafile::COALESCE_SIZE / size + 1; ++i) {
+		index.emplace_back("x", i * size, size);
+	}
+	entries.clear();
+	for (const auto& entry : index) {
+		entries.push_back(&entry);
+	}
+	ASSERT_EQ(runs({{0, index.size() - 1}, {index.size() - 1, index.size()}}), datafile::coalesce(entries));
+
+	// Or at the limit given, which follows the buffer size
+	ASSERT_EQ(runs({{0, 2}, {2, 4}}), datafile::coalesce(std::span(entries).first(4), size * 2));
+	datafile df;
+	ASSERT_EQ(datafile::DEFAULT_BUFFER_SIZE, df.coalesce_limit());
+	df.set_buffer_size(1);
+	ASSERT_EQ(datafile::SMALL_ENTRY_SIZE, df.coalesce_limit());
+	df.set_buffer_size(datafile::COALESCE_SIZE * 2);
+	ASSERT_EQ(datafile::COALESCE_SIZE, df.coalesce_limit());
+}
+
+TEST_F(datafile_tests, extract_coalesced) {
+	// Small files around one big one, so the archive is extracted as a mix of shared and single reads
+	std::vector<std::pair<std::string, std::string>> files = {
+		{"scripts/a.xml", "<a/>"},
+		{"scripts/b.xml", ""},
+		{"scripts/c.xml", "<c>text</c>"},
+		{"big.bin", std::string(datafile::SMALL_ENTRY_SIZE * 2, 'B')},
+		{"t/d.txt", "d"},
+		{"t/e.txt", "eeeee"},
+	};
+	std::string cat = "coalesce.dat\n";
+	std::string dat;
+	for (const auto& [name, contents] : files) {
+		cat += name + " " + std::to_string(contents.size()) + "\n";
+		dat += contents;
+	}
+	write_cat(TEST_DIR + "/coalesce.cat", cat);
+	dat_cipher((const uint8_t*)dat.data(), (uint8_t*)dat.data(), dat.size());
+	std::ofstream(TEST_DIR + "/coalesce.dat", std::ios::out | std::ios::binary) << dat;
+
+	// Page cache hints and preallocation don't change what comes out
+	for (int mode = 0; mode < 4; ++mode) {
+		datafile df(TEST_DIR + "/coalesce.cat");
+		if (mode % 2 == 1) {
+			ASSERT_TRUE(df.map_datfile());
+		}
+		if (mode >= 2) {
+			df.drop_cache_after_extract();
+		}
+		std::string extract_dir = TEST_DIR + "/coalesced" + std::to_string(mode);
+		ASSERT_TRUE(df.extract(extract_dir, 2));
+		for (const auto& [name, contents] : files) {
+			ASSERT_EQ(contents, test_utils::read_file(extract_dir + "/" + name)) << name;
+		}
+		ASSERT_EQ(datafile::SMALL_ENTRY_SIZE * 2, std::filesystem::file_size(extract_dir + "/big.bin"));
+	}
+
+	// A .dat file that's cut short fails the shared read
+	std::filesystem::resize_file(TEST_DIR + "/coalesce.dat", 10);
+	datafile df(TEST_DIR + "/coalesce.cat");
+	ASSERT_FALSE(df.extract(TEST_DIR + "/coalesced_short"));
+}
+
+TEST_F(datafile_tests, extract_archive_parallel_missing_datfile) {
+	std::filesystem::path dir = std::filesystem::path(TEST_DIR) / "path with spaces";
+	datafile df(dir / "test.cat");
+	std::filesystem::remove(dir / "test.dat");
+
+	ASSERT_FALSE(df.extract(TEST_DIR + "/test_extract_jobs_fail", 4));
+}
+
+TEST_F(datafile_tests, extract_truncated_datfile) {
+	// The second file runs past the end of the .dat, so it can only be read in part
+	const size_t big = datafile::SMALL_ENTRY_SIZE * 2;
+	write_cat(TEST_DIR + "/truncated.cat", "truncated.dat\nwhole.txt 5\ncut.bin " + std::to_string(big) + "\n");
+	std::string dat = "hello" + std::string(big / 2, 'C');
+	dat_cipher((const uint8_t*)dat.data(), (uint8_t*)dat.data(), dat.size());
+	std::ofstream(TEST_DIR + "/truncated.dat", std::ios::out | std::ios::binary) << dat;
+
+	for (bool mapped : {false, true}) {
+		datafile df(TEST_DIR + "/truncated.cat");
+		df.set_buffer_size(1000);
+		if (mapped) {
+			ASSERT_TRUE(df.map_datfile());
+		}
+
+		// A file that's already there isn't wiped out by a failed extraction
+		std::string single = TEST_DIR + "/truncated_single.bin";
+		std::ofstream(single) << "old";
+		ASSERT_FALSE(df.extract_one_file("cut.bin", single));
+		ASSERT_FALSE(std::filesystem::exists(single));
+
+		for (int jobs : {1, 2}) {
+			std::string extract_dir = TEST_DIR + "/truncated_out" + std::to_string(jobs) + (mapped ? "_mapped" : "");
+			ASSERT_FALSE(df.extract(extract_dir, jobs));
+			ASSERT_EQ("hello", test_utils::read_file(extract_dir + "/whole.txt"));
+			ASSERT_FALSE(std::filesystem::exists(extract_dir + "/cut.bin"));
+		}
+	}
+}
+
+TEST_F(datafile_tests, large_archive) {
+	// A 5 GiB hole followed by one small file, so the small file only lands in the right
+	// place if offsets don't wrap at 4 GiB. Sparse files keep this cheap on disk.
+	const uint64_t hole = 5ull * 1024 * 1024 * 1024;
+	write_cat(TEST_DIR + "/large.cat", "large.dat\nhole.bin " + std::to_string(hole) + "\nsmall.txt 5\n");
+
+	std::string contents("hello");
+	dat_cipher((const uint8_t*)contents.data(), (uint8_t*)contents.data(), contents.size());
+	{
+		std::ofstream dat(TEST_DIR + "/large.dat", std::ios::out | std::ios::binary);
+		dat.write(contents.data(), contents.size());
+	}
+	std::error_code ec;
+	std::filesystem::resize_file(TEST_DIR + "/large.dat", hole, ec);
+	if (ec) {
+		GTEST_SKIP() << "Cannot create sparse files here: " << ec.message();
+	}
+	{
+		std::fstream dat(TEST_DIR + "/large.dat", std::ios::in | std::ios::out | std::ios::binary);
+		dat.seekp(hole);
+		dat.write(contents.data(), contents.size());
+		ASSERT_TRUE(dat);
+	}
+
+	datafile df(TEST_DIR + "/large.cat");
+	auto entry = df.find_entry("small.txt", true);
+	ASSERT_TRUE(entry);
+	ASSERT_EQ(hole, entry->offset);
+	ASSERT_EQ(hole, df.find_entry("hole.bin", true)->size);
+
+	ASSERT_TRUE(df.extract_one_file("small.txt", TEST_DIR + "/small.txt"));
+	ASSERT_EQ("hello", test_utils::read_file(TEST_DIR + "/small.txt"));
+
+	ASSERT_TRUE(df.map_datfile(ACCESS_RANDOM));
+	ASSERT_EQ(std::vector<uint8_t>({'h', 'e', 'l', 'l', 'o'}), df.extract_entry_to_buffer(*entry));
+}
+
+TEST_F(datafile_tests, parse_offset_overflow) {
+	// The sizes add up to more than a 64-bit offset can hold
+	write_cat(TEST_DIR + "/overflow.cat", "overflow.dat\na 18446744073709551615\nb 1\n");
+	datafile df;
+	ASSERT_FALSE(df.parse(TEST_DIR + "/overflow.cat"));
+
+	write_cat(TEST_DIR + "/overflow.cat", "overflow.dat\na 99999999999999999999\n");
+	ASSERT_FALSE(df.parse(TEST_DIR + "/overflow.cat"));
+}
+
+TEST_F(datafile_tests, reparse_corrupt_catalog) {
+	datafile df(TEST_CAT);
+	ASSERT_TRUE(df.find_entry("testfile2.ext", false));
+
+	// A failed parse leaves nothing behind that refers to the old catalog
+	write_cat(TEST_DIR + "/overflow.cat", "overflow.dat\na 1\nb 99999999999999999999\n");
+	ASSERT_FALSE(df.parse(TEST_DIR + "/overflow.cat"));
+	ASSERT_FALSE(df.find_entry("testfile2.ext", false));
+	ASSERT_FALSE(df.find_entry("a", true));
+	ASSERT_TRUE(df.get_entries().empty());
+	ASSERT_TRUE(df.get_catfile_name().empty());
+
+	// The same goes for an index that doesn't fit its paths
+	ASSERT_TRUE(df.parse(TEST_CAT));
+	std::vector<uint64_t> sizes = {1, 2};
+	std::vector<uint32_t> lengths = {1, 100};
+	ASSERT_FALSE(df.load_compact(TEST_CAT, "test.dat", "ab", sizes, lengths));
+	ASSERT_FALSE(df.find_entry("testfile2.ext", false));
+	ASSERT_FALSE(df.find_entry("a", true));
 }
 
 TEST_F(datafile_tests, build_and_parse) {
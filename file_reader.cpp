@@ -0,0 +1,89 @@
+#include "file_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+file_reader::state::~state() {
+	if (fd >= 0) {
+		::close(fd);
+	}
+}
+
+void file_reader::reset(const std::filesystem::path& path) {
+	m_state = std::make_unique<state>();
+	m_state->path = path;
+}
+
+int file_reader::fd() const {
+	if (!m_state) {
+		return -1;
+	}
+
+	std::call_once(m_state->opened, [this] {
+		m_state->fd = ::open(m_state->path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (m_state->fd < 0) {
+			std::cerr << "Could not open " << m_state->path << ": " << strerror(errno) << std::endl;
+		}
+	});
+	return m_state->fd;
+}
+
+const std::filesystem::path& file_reader::path() const {
+	static const std::filesystem::path empty;
+	return m_state ? m_state->path : empty;
+}
+
+void file_reader::advise(access_pattern pattern) const {
+	int file = fd();
+	if (file >= 0) {
+		posix_fadvise(file,
+		              0,
+		              0,
+		              pattern == ACCESS_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL
+		              : pattern == ACCESS_RANDOM   ? POSIX_FADV_RANDOM
+		                                           : POSIX_FADV_NORMAL);
+	}
+}
+
+void file_reader::will_need(uint64_t offset, uint64_t len) const {
+	int file = fd();
+	if (file >= 0 && len > 0) {
+		posix_fadvise(file, offset, len, POSIX_FADV_WILLNEED);
+	}
+}
+
+void file_reader::dont_need(uint64_t offset, uint64_t len) const {
+	int file = fd();
+	if (file >= 0 && len > 0) {
+		posix_fadvise(file, offset, len, POSIX_FADV_DONTNEED);
+	}
+}
+
+bool file_reader::read_at(uint8_t* dst, uint64_t offset, size_t len) const {
+	int file = fd();
+	if (file < 0) {
+		return false;
+	}
+
+	while (len > 0) {
+		ssize_t n = pread(file, dst, len, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (n == 0) {
+			// End of file before we got everything
+			return false;
+		}
+		dst += n;
+		offset += n;
+		len -= n;
+	}
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+#include "mapped_file.h"
+
+/**
+ * A read-only file that is opened the first time it is read from and then kept
+ * open for the life of the object.
+ *
+ * Reads are positional (pread), so there is no shared seek state and any number
+ * of threads may read through the same file_reader at once.
+ */
+class file_reader {
+public:
+	file_reader() {}
+	explicit file_reader(const std::filesystem::path& path) { reset(path); }
+
+	/**
+	 * Point the reader at a different file. Any open descriptor is closed. Not thread-safe.
+	 */
+	void reset(const std::filesystem::path& path);
+
+	/**
+	 * Read exactly len bytes starting at offset. Returns false on error or if the file is too short.
+	 */
+	bool read_at(uint8_t* dst, uint64_t offset, size_t len) const;
+
+	/**
+	 * Tell the kernel how the whole file is going to be read, e.g. so it reads further ahead.
+	 */
+	void advise(access_pattern pattern) const;
+
+	/**
+	 * Start reading a range into the page cache in the background, ahead of read_at().
+	 */
+	void will_need(uint64_t offset, uint64_t len) const;
+
+	/**
+	 * Let the kernel drop a range that won't be read again from the page cache.
+	 */
+	void dont_need(uint64_t offset, uint64_t len) const;
+
+	/**
+	 * Get the file descriptor, opening the file if needed. Returns -1 if the file can't be opened.
+	 */
+	int fd() const;
+
+	const std::filesystem::path& path() const;
+
+private:
+	struct state {
+		std::filesystem::path path;
+		std::once_flag opened;
+		int fd = -1;
+
+		~state();
+	};
+
+	// Kept behind a pointer so that the reader can be moved even though once_flag can't
+	std::unique_ptr<state> m_state;
+};
@@ -0,0 +1,94 @@
+#include "file_reader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+static const std::string TEST_DIR = "test_file_reader";
+
+class file_reader_tests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+		std::filesystem::create_directories(TEST_DIR);
+
+		std::ofstream f(TEST_DIR + "/data.bin", std::ios::binary);
+		for (int i = 0; i < 4096; ++i) {
+			f.put((char)(i % 251));
+		}
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+};
+
+TEST_F(file_reader_tests, read_at) {
+	file_reader reader(TEST_DIR + "/data.bin");
+	uint8_t buf[4];
+
+	ASSERT_TRUE(reader.read_at(buf, 0, 4));
+	ASSERT_EQ(0, buf[0]);
+	ASSERT_EQ(3, buf[3]);
+
+	ASSERT_TRUE(reader.read_at(buf, 300, 4));
+	ASSERT_EQ(300 % 251, buf[0]);
+
+	// Reading the last byte is fine, reading past the end is not
+	ASSERT_TRUE(reader.read_at(buf, 4095, 1));
+	ASSERT_FALSE(reader.read_at(buf, 4094, 4));
+	ASSERT_TRUE(reader.read_at(buf, 4096, 0));
+}
+
+TEST_F(file_reader_tests, opens_lazily) {
+	file_reader reader(TEST_DIR + "/later.bin");
+
+	// The file doesn't have to exist until the first read
+	{
+		std::ofstream f(TEST_DIR + "/later.bin", std::ios::binary);
+		f << "abc";
+	}
+	uint8_t buf[3];
+	ASSERT_TRUE(reader.read_at(buf, 0, 3));
+	ASSERT_EQ('c', buf[2]);
+	ASSERT_GE(reader.fd(), 0);
+}
+
+TEST_F(file_reader_tests, missing_file) {
+	file_reader reader(TEST_DIR + "/nonexistent.bin");
+	uint8_t buf[1];
+	ASSERT_FALSE(reader.read_at(buf, 0, 1));
+	ASSERT_EQ(-1, reader.fd());
+
+	file_reader empty;
+	ASSERT_FALSE(empty.read_at(buf, 0, 1));
+}
+
+TEST_F(file_reader_tests, concurrent_reads) {
+	file_reader reader(TEST_DIR + "/data.bin");
+
+	std::vector<std::thread> threads;
+	std::vector<int> failures(8, 0);
+	for (size_t t = 0; t < failures.size(); ++t) {
+		threads.emplace_back([&, t] {
+			uint8_t buf[64];
+			for (uint64_t off = t; off + sizeof(buf) <= 4096; off += 61) {
+				if (!reader.read_at(buf, off, sizeof(buf)) || buf[0] != off % 251 || buf[63] != (off + 63) % 251) {
+					failures[t]++;
+				}
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	for (int f : failures) {
+		ASSERT_EQ(0, f);
+	}
+}
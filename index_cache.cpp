@@ -0,0 +1,252 @@
+#include "index_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+static const char CACHE_MAGIC[8] = {'X', '3', 'T', 'I', 'D', 'X', '0', '3'};
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+struct cache_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t catalogs;
+};
+
+struct index_cache::record {
+	uint32_t id;
+	uint32_t filename_len;
+	uint64_t cat_size;
+	int64_t cat_mtime;
+	uint64_t entries;
+	uint64_t data_offset; // Where this catalog's data starts; always 8-byte aligned
+	uint32_t header_len;
+	uint32_t bloom_hashes;
+	uint64_t paths_size;
+	uint64_t bloom_words;
+};
+
+// Where the parts of a catalog's data are, in the order they are stored
+struct index_cache::catalog_data {
+	const uint64_t* bloom;
+	const uint64_t* sizes;
+	const uint32_t* path_lengths;
+	std::string_view filename;
+	std::string_view header;
+	std::string_view paths;
+};
+
+static bool stat_catalog(const std::filesystem::path& catfile, uint64_t& size, int64_t& mtime) {
+	std::error_code ec;
+	size = std::filesystem::file_size(catfile, ec);
+	if (ec) {
+		return false;
+	}
+	mtime = std::filesystem::last_write_time(catfile, ec).time_since_epoch().count();
+	return !ec;
+}
+
+bool index_cache::open(const std::filesystem::path& path) {
+	m_records = nullptr;
+	m_count = 0;
+	if (!m_file.open(path, ACCESS_RANDOM)) {
+		return false;
+	}
+
+	auto header_bytes = m_file.view(0, sizeof(cache_header));
+	if (header_bytes.empty()) {
+		m_file.close();
+		return false;
+	}
+	const cache_header* header = (const cache_header*)header_bytes.data();
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header->byte_order != CACHE_BYTE_ORDER) {
+		m_file.close();
+		return false;
+	}
+
+	auto record_bytes = m_file.view(sizeof(cache_header), (uint64_t)header->catalogs * sizeof(record));
+	if (record_bytes.size() != (uint64_t)header->catalogs * sizeof(record)) {
+		m_file.close();
+		return false;
+	}
+
+	// Check every record up front, so load() can trust them
+	const record* records = (const record*)record_bytes.data();
+	for (uint32_t i = 0; i < header->catalogs; ++i) {
+		// Nothing can be bigger than the file, which also keeps the sums below from overflowing
+		const record& r = records[i];
+		uint64_t limit = m_file.size();
+		if (r.entries > limit || r.paths_size > limit || r.bloom_words > limit ||
+		    r.data_offset % alignof(uint64_t) != 0 || r.bloom_hashes == 0 ||
+		    r.bloom_hashes > bloom_filter::MAX_HASHES) {
+			m_file.close();
+			return false;
+		}
+		uint64_t size = r.bloom_words * sizeof(uint64_t) + r.entries * (sizeof(uint64_t) + sizeof(uint32_t)) +
+		                r.filename_len + r.header_len + r.paths_size;
+		if (m_file.view(r.data_offset, size).size() != size) {
+			m_file.close();
+			return false;
+		}
+	}
+
+	m_records = records;
+	m_count = header->catalogs;
+	return true;
+}
+
+index_cache::catalog_data index_cache::get_data(const record& r) const {
+	catalog_data d;
+	const uint8_t* data = m_file.data() + r.data_offset;
+	d.bloom = (const uint64_t*)data;
+	data += r.bloom_words * sizeof(uint64_t);
+	d.sizes = (const uint64_t*)data;
+	data += r.entries * sizeof(uint64_t);
+	d.path_lengths = (const uint32_t*)data;
+	data += r.entries * sizeof(uint32_t);
+	d.filename = std::string_view((const char*)data, r.filename_len);
+	data += r.filename_len;
+	d.header = std::string_view((const char*)data, r.header_len);
+	data += r.header_len;
+	d.paths = std::string_view((const char*)data, r.paths_size);
+	return d;
+}
+
+const index_cache::record* index_cache::find(uint32_t id, const std::filesystem::path& catfile) const {
+	for (uint32_t i = 0; i < m_count; ++i) {
+		const record& r = m_records[i];
+		if (r.id != id) {
+			continue;
+		}
+
+		uint64_t size;
+		int64_t mtime;
+		if (get_data(r).filename != catfile.filename().string() ||
+		    !stat_catalog(catfile, size, mtime) || size != r.cat_size || mtime != r.cat_mtime) {
+			return nullptr;
+		}
+		return &r;
+	}
+	return nullptr;
+}
+
+bool index_cache::load(uint32_t id, const std::filesystem::path& catfile, datafile& df) const {
+	const record* r = find(id, catfile);
+	if (!r) {
+		return false;
+	}
+
+	catalog_data d = get_data(*r);
+	return df.load_compact(catfile,
+	                       std::string(d.header),
+	                       d.paths,
+	                       std::span<const uint64_t>(d.sizes, r->entries),
+	                       std::span<const uint32_t>(d.path_lengths, r->entries));
+}
+
+bool index_cache::load_bloom(uint32_t id, const std::filesystem::path& catfile, bloom_filter& filter) const {
+	const record* r = find(id, catfile);
+	if (!r || r->bloom_words == 0) {
+		return false;
+	}
+
+	catalog_data d = get_data(*r);
+	filter = bloom_filter(std::span<const uint64_t>(d.bloom, r->bloom_words), r->bloom_hashes);
+	return true;
+}
+
+template <typename T> static void append(std::vector<uint8_t>& out, const T* data, size_t count) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+bool index_cache::write(const std::filesystem::path& path, const std::map<uint32_t, datafile>& catalogs) {
+	std::map<uint32_t, const datafile*> pointers;
+	for (const auto& [id, df] : catalogs) {
+		pointers.emplace(id, &df);
+	}
+	return write(path, pointers);
+}
+
+bool index_cache::write(const std::filesystem::path& path, const std::map<uint32_t, const datafile*>& catalogs) {
+	std::vector<record> records;
+	std::vector<uint8_t> data;
+
+	for (const auto& [id, catalog] : catalogs) {
+		const datafile& df = *catalog;
+		record r = {};
+		if (df.get_catfile_name().empty() || !stat_catalog(df.get_catfile_name(), r.cat_size, r.cat_mtime)) {
+			// Nothing worth remembering about a catalog that isn't there
+			continue;
+		}
+
+		const auto& entries = df.get_entries();
+		std::string filename = std::filesystem::path(df.get_catfile_name()).filename().string();
+		r.id = id;
+		r.entries = entries.size();
+		r.filename_len = filename.size();
+		r.header_len = df.get_cat_header().size();
+		r.bloom_words = df.get_bloom().words().size();
+		r.bloom_hashes = df.get_bloom().hashes();
+		r.data_offset = data.size();
+
+		append(data, df.get_bloom().words().data(), df.get_bloom().words().size());
+		for (const auto& entry : entries) {
+			append(data, &entry.size, 1);
+		}
+		for (const auto& entry : entries) {
+			uint32_t len = entry.relpath.size();
+			append(data, &len, 1);
+		}
+		append(data, filename.data(), filename.size());
+		append(data, df.get_cat_header().data(), df.get_cat_header().size());
+		for (const auto& entry : entries) {
+			append(data, entry.relpath.data(), entry.relpath.size());
+			r.paths_size += entry.relpath.size();
+		}
+		data.resize((data.size() + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1));
+
+		records.push_back(r);
+	}
+
+	cache_header header = {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.byte_order = CACHE_BYTE_ORDER;
+	header.catalogs = records.size();
+
+	// The data goes after the records, so its offsets move along by that much
+	uint64_t data_start = sizeof(header) + records.size() * sizeof(record);
+	for (auto& r : records) {
+		r.data_offset += data_start;
+	}
+
+	std::filesystem::path tmp_path = path;
+	tmp_path += ".tmp";
+	std::ofstream out(tmp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Could not open " << tmp_path << " for writing\n";
+		return false;
+	}
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)records.data(), records.size() * sizeof(record));
+	out.write((const char*)data.data(), data.size());
+	out.close();
+	if (!out) {
+		std::cerr << "Error when writing " << tmp_path << std::endl;
+		std::error_code ec;
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		std::cerr << "Could not replace " << path << ": " << ec.message() << std::endl;
+		std::filesystem::remove(tmp_path, ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include "bloom_filter.h"
+#include "datafile.h"
+#include "mapped_file.h"
+
+/**
+ * A binary copy of the indexes of a directory's catalogs, so they don't have to be
+ * decrypted and parsed every time.
+ *
+ * Each catalog's index is saved along with the size and modification time of the .cat
+ * file it came from, and only used again if the .cat file still matches. The file is
+ * memory-mapped and read in place; nothing is parsed until a catalog is asked for.
+ *
+ * Layout (native byte order, checked on load):
+ *   header
+ *   catalog records[catalogs]
+ *   for each catalog: uint64_t bloom[bloom_words], uint64_t sizes[entries],
+ *                     uint32_t path_lengths[entries], .cat filename, catalog header,
+ *                     paths back to back
+ */
+class index_cache {
+public:
+	/**
+	 * Map an existing cache file. Returns false if it doesn't exist or isn't a valid cache,
+	 * in which case load() finds nothing.
+	 */
+	bool open(const std::filesystem::path& path);
+
+	/**
+	 * Set up df from the cache, if the cache has an up to date index for this catalog.
+	 */
+	bool load(uint32_t id, const std::filesystem::path& catfile, datafile& df) const;
+
+	/**
+	 * Get the Bloom filter of a catalog's index, if the cache has an up to date one.
+	 * This is much cheaper than load(), and enough to tell that a catalog lacks a file.
+	 */
+	bool load_bloom(uint32_t id, const std::filesystem::path& catfile, bloom_filter& filter) const;
+
+	/**
+	 * Whether the cache has an up to date index for this catalog.
+	 */
+	bool is_current(uint32_t id, const std::filesystem::path& catfile) const { return find(id, catfile) != nullptr; }
+
+	/**
+	 * Save the indexes of the given catalogs, replacing the cache file.
+	 * The file is written next to its final name and renamed into place, so a
+	 * reader never sees a partial cache.
+	 */
+	static bool write(const std::filesystem::path& path, const std::map<uint32_t, const datafile*>& catalogs);
+	static bool write(const std::filesystem::path& path, const std::map<uint32_t, datafile>& catalogs);
+
+private:
+	struct record;
+	struct catalog_data;
+	const record* find(uint32_t id, const std::filesystem::path& catfile) const;
+	catalog_data get_data(const record& r) const;
+
+	mapped_file m_file;
+	const record* m_records = nullptr;
+	uint32_t m_count = 0;
+};
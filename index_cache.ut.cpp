@@ -0,0 +1,188 @@
+#include "index_cache.h"
+#include "datadir.h"
+#include "test_utils.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <gtest/gtest.h>
+
+static const std::string TEST_DIR = "test_index_cache";
+static const std::string CACHE_FILE = TEST_DIR + "/cache.idx";
+
+class index_cache_tests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+		std::filesystem::create_directories(TEST_DIR);
+		std::filesystem::copy("test_artifacts/composite", TEST_DIR + "/data", ec);
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+};
+
+TEST_F(index_cache_tests, round_trip) {
+	std::map<uint32_t, datafile> catalogs;
+	catalogs.emplace(1, datafile(TEST_DIR + "/data/1.cat"));
+	catalogs.emplace(10, datafile(TEST_DIR + "/data/10.cat"));
+	ASSERT_TRUE(index_cache::write(CACHE_FILE, catalogs));
+
+	index_cache cache;
+	ASSERT_TRUE(cache.open(CACHE_FILE));
+
+	datafile df;
+	ASSERT_TRUE(cache.load(10, TEST_DIR + "/data/10.cat", df));
+	ASSERT_TRUE(df.is_compact());
+	ASSERT_EQ(catalogs[10].get_index_listing(), df.get_index_listing());
+	ASSERT_EQ(catalogs[10].get_datfile_name(), df.get_datfile_name());
+
+	// Offsets are rebuilt from the sizes, so the data still comes out right
+	ASSERT_TRUE(df.extract_one_file("models/ship.mdl", TEST_DIR + "/ship.mdl", true));
+	ASSERT_EQ("Model v10 FINAL\n", test_utils::read_file(TEST_DIR + "/ship.mdl"));
+
+	// Catalogs that were never saved aren't there
+	ASSERT_FALSE(cache.load(2, TEST_DIR + "/data/2.cat", df));
+}
+
+TEST_F(index_cache_tests, stale_catalog) {
+	std::map<uint32_t, datafile> catalogs;
+	catalogs.emplace(1, datafile(TEST_DIR + "/data/1.cat"));
+	catalogs.emplace(2, datafile(TEST_DIR + "/data/2.cat"));
+	ASSERT_TRUE(index_cache::write(CACHE_FILE, catalogs));
+
+	// Touching a catalog makes its cached index useless, but leaves the others alone
+	auto mtime = std::filesystem::last_write_time(TEST_DIR + "/data/2.cat");
+	std::filesystem::last_write_time(TEST_DIR + "/data/2.cat", mtime + std::chrono::seconds(1));
+
+	index_cache cache;
+	ASSERT_TRUE(cache.open(CACHE_FILE));
+	ASSERT_TRUE(cache.is_current(1, TEST_DIR + "/data/1.cat"));
+	ASSERT_FALSE(cache.is_current(2, TEST_DIR + "/data/2.cat"));
+
+	// The same ID from another file doesn't count either
+	ASSERT_FALSE(cache.is_current(1, TEST_DIR + "/data/10.cat"));
+}
+
+TEST_F(index_cache_tests, invalid_file) {
+	index_cache cache;
+	ASSERT_FALSE(cache.open(TEST_DIR + "/missing.idx"));
+
+	std::ofstream(CACHE_FILE) << "not a cache";
+	ASSERT_FALSE(cache.open(CACHE_FILE));
+
+	datafile df;
+	ASSERT_FALSE(cache.load(1, TEST_DIR + "/data/1.cat", df));
+
+	// A Bloom filter that asks for no probes, or far too many, spoils the whole cache
+	std::map<uint32_t, datafile> catalogs;
+	catalogs.emplace(1, datafile(TEST_DIR + "/data/1.cat"));
+	const std::streamoff hashes_at = 16 + 44; // Header, then bloom_hashes in the first record
+	for (uint32_t hashes : {0u, bloom_filter::MAX_HASHES + 1, 0xffffffffu}) {
+		ASSERT_TRUE(index_cache::write(CACHE_FILE, catalogs));
+		ASSERT_TRUE(cache.open(CACHE_FILE));
+		{
+			std::fstream f(CACHE_FILE, std::ios::in | std::ios::out | std::ios::binary);
+			f.seekp(hashes_at);
+			f.write((const char*)&hashes, sizeof(hashes));
+			ASSERT_TRUE(f);
+		}
+		ASSERT_FALSE(cache.open(CACHE_FILE)) << hashes;
+		bloom_filter filter;
+		ASSERT_FALSE(cache.load_bloom(1, TEST_DIR + "/data/1.cat", filter));
+	}
+}
+
+TEST_F(index_cache_tests, datadir_uses_cache) {
+	const std::string cache_path = TEST_DIR + "/data/" + datadir::CACHE_FILENAME;
+	{
+		datadir dd(TEST_DIR + "/data");
+		dd.use_cache(cache_path);
+		dd.load_all();
+		ASSERT_TRUE(dd.save_cache());
+	}
+	ASSERT_TRUE(std::filesystem::exists(cache_path));
+
+	// Break a catalog; if the cache is used, nobody notices
+	auto mtime = std::filesystem::last_write_time(TEST_DIR + "/data/10.cat");
+	auto size = std::filesystem::file_size(TEST_DIR + "/data/10.cat");
+	std::filesystem::resize_file(TEST_DIR + "/data/2.cat", 1);
+	std::filesystem::resize_file(TEST_DIR + "/data/10.cat", 0);
+	std::filesystem::resize_file(TEST_DIR + "/data/10.cat", size);
+	std::filesystem::last_write_time(TEST_DIR + "/data/10.cat", mtime);
+
+	datadir dd(TEST_DIR + "/data");
+	dd.use_cache(cache_path);
+
+	// 2.cat changed size, so it gets parsed again (and comes out empty)
+	const datadir::overlay_entry* found = dd.find("models/station.mdl", true);
+	ASSERT_TRUE(found);
+	ASSERT_EQ(1u, found->id);
+
+	// 10.cat is still taken from the cache, since its size and time were put back
+	found = dd.find("ship.mdl", false);
+	ASSERT_TRUE(found);
+	ASSERT_EQ(10u, found->id);
+}
+
+TEST_F(index_cache_tests, bloom_skips_catalogs) {
+	const std::string cache_path = TEST_DIR + "/data/" + datadir::CACHE_FILENAME;
+	{
+		datadir dd(TEST_DIR + "/data");
+		dd.use_cache(cache_path);
+		dd.load_all();
+		ASSERT_TRUE(dd.save_cache());
+	}
+
+	index_cache cache;
+	ASSERT_TRUE(cache.open(cache_path));
+	bloom_filter filter;
+	ASSERT_TRUE(cache.load_bloom(10, TEST_DIR + "/data/10.cat", filter));
+	ASSERT_TRUE(datafile::may_contain(filter, "models/ship.mdl", true));
+	ASSERT_TRUE(datafile::may_contain(filter, "ship.mdl", false));
+
+	// scripts/main.lua is only in 1.cat; the filters of 10.cat and 2.cat rule them out
+	datadir dd(TEST_DIR + "/data");
+	dd.use_cache(cache_path);
+	const datadir::overlay_entry* found = dd.find("main.lua", false);
+	ASSERT_TRUE(found);
+	ASSERT_EQ(1u, found->id);
+	ASSERT_EQ(1u, dd.loaded());
+
+	// Nothing has the file, and no catalog needs loading to know that
+	ASSERT_FALSE(dd.find("nonexistent/file.txt", true));
+	ASSERT_EQ(1u, dd.loaded());
+}
+
+TEST_F(index_cache_tests, save_leaves_unloaded_catalogs) {
+	const std::string cache_path = TEST_DIR + "/data/" + datadir::CACHE_FILENAME;
+	{
+		datadir dd(TEST_DIR + "/data");
+		dd.use_cache(cache_path);
+		dd.load_all();
+		ASSERT_TRUE(dd.save_cache());
+	}
+
+	// 1.cat has to be parsed again, which makes the cache worth saving
+	auto mtime = std::filesystem::last_write_time(TEST_DIR + "/data/1.cat");
+	std::filesystem::last_write_time(TEST_DIR + "/data/1.cat", mtime + std::chrono::seconds(1));
+
+	datadir dd(TEST_DIR + "/data");
+	dd.use_cache(cache_path);
+	ASSERT_TRUE(dd.find("main.lua", false));
+	ASSERT_EQ(1u, dd.loaded());
+	ASSERT_TRUE(dd.save_cache());
+
+	// The catalogs that were never needed are saved, but still not loaded
+	ASSERT_EQ(1u, dd.loaded());
+	index_cache cache;
+	ASSERT_TRUE(cache.open(cache_path));
+	ASSERT_TRUE(cache.is_current(1, TEST_DIR + "/data/1.cat"));
+	ASSERT_TRUE(cache.is_current(2, TEST_DIR + "/data/2.cat"));
+	ASSERT_TRUE(cache.is_current(10, TEST_DIR + "/data/10.cat"));
+}
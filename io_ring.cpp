@@ -0,0 +1,174 @@
+#include "io_ring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+
+// Operations the extractor relies on, which arrived at different kernel versions
+static const uint8_t REQUIRED_OPS[] = {
+	IORING_OP_READ_FIXED,
+	IORING_OP_WRITE_FIXED,
+	IORING_OP_READ,
+	IORING_OP_WRITE,
+	IORING_OP_OPENAT,
+	IORING_OP_CLOSE,
+	IORING_OP_FALLOCATE,
+	IORING_OP_SYNC_FILE_RANGE,
+	IORING_OP_FADVISE,
+};
+
+static bool supports_required_ops(int fd) {
+	const unsigned ops = 256;
+	auto buffer = std::make_unique<uint8_t[]>(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op));
+	io_uring_probe* probe = (io_uring_probe*)buffer.get();
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, ops) < 0) {
+		// Kernels too old to probe are too old for some of the operations as well
+		return false;
+	}
+	for (uint8_t op : REQUIRED_OPS) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool io_ring::init(unsigned entries) {
+	close();
+
+	io_uring_params params = {};
+	m_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (m_fd < 0) {
+		m_fd = -1;
+		return false;
+	}
+	if (!supports_required_ops(m_fd)) {
+		close();
+		return false;
+	}
+
+	m_sq_entries = params.sq_entries;
+	m_cq_entries = params.cq_entries;
+	m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+	}
+
+	void* sq =
+		mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) {
+		close();
+		return false;
+	}
+	m_sq_ring = sq;
+
+	if (single_mmap) {
+		m_cq_ring = m_sq_ring;
+	} else {
+		void* cq =
+			mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			close();
+			return false;
+		}
+		m_cq_ring = cq;
+	}
+
+	void* sqes = mmap(nullptr,
+	                  params.sq_entries * sizeof(io_uring_sqe),
+	                  PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE,
+	                  m_fd,
+	                  IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		close();
+		return false;
+	}
+	m_sqes = (io_uring_sqe*)sqes;
+
+	uint8_t* sq_ring = (uint8_t*)m_sq_ring;
+	m_sq_head = (unsigned*)(sq_ring + params.sq_off.head);
+	m_sq_tail = (unsigned*)(sq_ring + params.sq_off.tail);
+	m_sq_mask = (unsigned*)(sq_ring + params.sq_off.ring_mask);
+	m_sq_array = (unsigned*)(sq_ring + params.sq_off.array);
+	uint8_t* cq_ring = (uint8_t*)m_cq_ring;
+	m_cq_head = (unsigned*)(cq_ring + params.cq_off.head);
+	m_cq_tail = (unsigned*)(cq_ring + params.cq_off.tail);
+	m_cq_mask = (unsigned*)(cq_ring + params.cq_off.ring_mask);
+	m_cqes = (io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+	return true;
+}
+
+void io_ring::close() {
+	if (m_sqes) {
+		munmap(m_sqes, m_sq_entries * sizeof(io_uring_sqe));
+	}
+	if (m_cq_ring && m_cq_ring != m_sq_ring) {
+		munmap(m_cq_ring, m_cq_ring_size);
+	}
+	if (m_sq_ring) {
+		munmap(m_sq_ring, m_sq_ring_size);
+	}
+	if (m_fd >= 0) {
+		::close(m_fd);
+	}
+	m_fd = -1;
+	m_sqes = nullptr;
+	m_sq_ring = m_cq_ring = nullptr;
+	m_unsubmitted = 0;
+}
+
+bool io_ring::register_buffers(std::span<const iovec> buffers) {
+	return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) == 0;
+}
+
+bool io_ring::queue(const io_uring_sqe& sqe) {
+	// Only this thread moves the tail; the kernel moves the head as it takes entries
+	unsigned tail = *m_sq_tail;
+	unsigned head = std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+	if (tail - head >= m_sq_entries) {
+		return false;
+	}
+
+	unsigned idx = tail & *m_sq_mask;
+	m_sqes[idx] = sqe;
+	m_sq_array[idx] = idx;
+	std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1, std::memory_order_release);
+	++m_unsubmitted;
+	return true;
+}
+
+bool io_ring::submit(unsigned wait_for) {
+	for (;;) {
+		unsigned flags = wait_for ? IORING_ENTER_GETEVENTS : 0;
+		long ret = syscall(__NR_io_uring_enter, m_fd, m_unsubmitted, wait_for, flags, nullptr, 0);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		m_unsubmitted -= std::min<unsigned>(ret, m_unsubmitted);
+		return true;
+	}
+}
+
+bool io_ring::pop(io_uring_cqe& cqe) {
+	// Only this thread moves the head; the kernel moves the tail as operations complete
+	unsigned head = *m_cq_head;
+	unsigned tail = std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+	if (head == tail) {
+		return false;
+	}
+
+	cqe = m_cqes[head & *m_cq_mask];
+	std::atomic_ref<unsigned>(*m_cq_head).store(head + 1, std::memory_order_release);
+	return true;
+}
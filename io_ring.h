@@ -0,0 +1,80 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/**
+ * A minimal io_uring submission/completion ring, set up with the raw system calls so
+ * that nothing beyond the kernel headers is needed.
+ *
+ * Only the calling thread may use a ring; give each thread its own.
+ */
+class io_ring {
+public:
+	io_ring() {}
+	~io_ring() { close(); }
+
+	io_ring(const io_ring&) = delete;
+	io_ring& operator=(const io_ring&) = delete;
+
+	/**
+	 * Set up a ring with room for at least entries submissions. Returns false if the
+	 * kernel doesn't have io_uring, or lacks one of the operations the extractor uses,
+	 * or it isn't allowed here; callers should then stick to ordinary system calls.
+	 */
+	bool init(unsigned entries);
+
+	void close();
+
+	bool is_open() const { return m_fd >= 0; }
+
+	/**
+	 * Register buffers for IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED, which saves the
+	 * kernel mapping them for every operation. Fails if they can't be pinned in memory.
+	 */
+	bool register_buffers(std::span<const iovec> buffers);
+
+	/**
+	 * Add an operation to the submission queue. Returns false if the queue is full.
+	 */
+	bool queue(const io_uring_sqe& sqe);
+
+	/**
+	 * Hand everything queued to the kernel, and wait until at least wait_for operations have
+	 * completed. Returns false on error.
+	 */
+	bool submit(unsigned wait_for);
+
+	/**
+	 * Take the next completion, if there is one.
+	 */
+	bool pop(io_uring_cqe& cqe);
+
+	/** How many completions the ring can hold before the kernel has to buffer them */
+	unsigned completion_entries() const { return m_cq_entries; }
+
+private:
+	int m_fd = -1;
+	unsigned m_sq_entries = 0;
+	unsigned m_cq_entries = 0;
+	unsigned m_unsubmitted = 0;
+
+	void* m_sq_ring = nullptr;
+	size_t m_sq_ring_size = 0;
+	void* m_cq_ring = nullptr;
+	size_t m_cq_ring_size = 0;
+	io_uring_sqe* m_sqes = nullptr;
+
+	unsigned* m_sq_head = nullptr;
+	unsigned* m_sq_tail = nullptr;
+	unsigned* m_sq_mask = nullptr;
+	unsigned* m_sq_array = nullptr;
+	unsigned* m_cq_head = nullptr;
+	unsigned* m_cq_tail = nullptr;
+	unsigned* m_cq_mask = nullptr;
+	io_uring_cqe* m_cqes = nullptr;
+};
@@ -0,0 +1,101 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+static int to_madvise(access_pattern pattern) {
+	switch (pattern) {
+	case ACCESS_SEQUENTIAL:
+		return MADV_SEQUENTIAL;
+	case ACCESS_RANDOM:
+		return MADV_RANDOM;
+	default:
+		return MADV_NORMAL;
+	}
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+	: m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)),
+	  m_open(std::exchange(other.m_open, false)) {}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+	if (this != &other) {
+		close();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_open = std::exchange(other.m_open, false);
+	}
+	return *this;
+}
+
+bool mapped_file::open(const std::filesystem::path& path, access_pattern pattern) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	// mmap refuses zero-length mappings, but an empty file is still a valid (empty) file
+	if (st.st_size > 0) {
+		void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+		m_data = (const uint8_t*)addr;
+	}
+
+	// The mapping holds its own reference to the file
+	::close(fd);
+
+	m_size = st.st_size;
+	m_open = true;
+	advise(pattern);
+	return true;
+}
+
+void mapped_file::close() {
+	if (m_data) {
+		munmap((void*)m_data, m_size);
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+void mapped_file::advise(access_pattern pattern) const {
+	if (m_data) {
+		madvise((void*)m_data, m_size, to_madvise(pattern));
+	}
+}
+
+void mapped_file::dont_need(uint64_t offset, uint64_t len) const {
+	if (!m_data || offset >= m_size || len == 0) {
+		return;
+	}
+	// Whole pages only; the mapping is read-only, so taking a neighbour's page along is harmless
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t start = offset & ~(page - 1);
+	uint64_t end = offset + std::min(len, m_size - offset);
+	madvise((void*)(m_data + start), end - start, MADV_DONTNEED);
+}
+
+std::span<const uint8_t> mapped_file::view(uint64_t offset, uint64_t len) const {
+	if (offset > m_size || len > m_size - offset) {
+		return {};
+	}
+	return {m_data + offset, len};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+/**
+ * How a mapped file is going to be read, passed on to the kernel as a paging hint.
+ */
+enum access_pattern {
+	ACCESS_NORMAL,
+	ACCESS_SEQUENTIAL, // Mostly front to back, e.g. extracting a whole archive
+	ACCESS_RANDOM,     // Scattered lookups, e.g. pulling a few files out of an archive
+};
+
+/**
+ * A read-only memory mapping of a whole file.
+ *
+ * The mapping lives as long as the object, so any view handed out is only
+ * valid until the mapped_file is closed or destroyed.
+ */
+class mapped_file {
+public:
+	mapped_file() {}
+	~mapped_file() { close(); }
+
+	mapped_file(mapped_file&& other) noexcept;
+	mapped_file& operator=(mapped_file&& other) noexcept;
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	/**
+	 * Map a file, replacing any existing mapping.
+	 */
+	bool open(const std::filesystem::path& path, access_pattern pattern = ACCESS_NORMAL);
+
+	/**
+	 * Unmap the file.
+	 */
+	void close();
+
+	/**
+	 * Change the paging hint for the whole mapping.
+	 */
+	void advise(access_pattern pattern) const;
+
+	/**
+	 * Unmap the pages of a range that won't be read again, so that the kernel can drop them
+	 * from the page cache. Reading them again later just maps them back in.
+	 */
+	void dont_need(uint64_t offset, uint64_t len) const;
+
+	/**
+	 * Get a view of part of the file. Returns an empty span if the range is not inside the file.
+	 */
+	std::span<const uint8_t> view(uint64_t offset, uint64_t len) const;
+
+	bool is_open() const { return m_open; }
+	const uint8_t* data() const { return m_data; }
+	uint64_t size() const { return m_size; }
+
+private:
+	const uint8_t* m_data = nullptr;
+	uint64_t m_size = 0;
+	bool m_open = false;
+};
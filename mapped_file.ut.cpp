@@ -0,0 +1,90 @@
+#include "mapped_file.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <gtest/gtest.h>
+
+static const std::string TEST_DIR = "test_mapped_file";
+
+class mapped_file_tests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+		std::filesystem::create_directories(TEST_DIR);
+
+		std::ofstream f(TEST_DIR + "/data.bin", std::ios::binary);
+		f << "0123456789";
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+};
+
+TEST_F(mapped_file_tests, map_and_view) {
+	mapped_file mf;
+	ASSERT_TRUE(mf.open(TEST_DIR + "/data.bin", ACCESS_SEQUENTIAL));
+	ASSERT_TRUE(mf.is_open());
+	ASSERT_EQ(10u, mf.size());
+
+	auto view = mf.view(3, 4);
+	ASSERT_EQ(4u, view.size());
+	ASSERT_EQ("3456", std::string(view.begin(), view.end()));
+
+	// The whole file and an empty range at the end are both fine
+	ASSERT_EQ(10u, mf.view(0, 10).size());
+	ASSERT_TRUE(mf.view(10, 0).empty());
+}
+
+TEST_F(mapped_file_tests, view_out_of_range) {
+	mapped_file mf;
+	ASSERT_TRUE(mf.open(TEST_DIR + "/data.bin"));
+
+	ASSERT_TRUE(mf.view(8, 3).empty());
+	ASSERT_TRUE(mf.view(11, 0).empty());
+	ASSERT_TRUE(mf.view(1, UINT64_MAX).empty());
+}
+
+TEST_F(mapped_file_tests, dont_need) {
+	mapped_file mf;
+	ASSERT_TRUE(mf.open(TEST_DIR + "/data.bin"));
+
+	// Dropped pages read back the same, and ranges past the end are ignored
+	mf.dont_need(2, 5);
+	mf.dont_need(8, UINT64_MAX);
+	mf.dont_need(20, 1);
+	auto view = mf.view(0, 10);
+	ASSERT_EQ("0123456789", std::string(view.begin(), view.end()));
+}
+
+TEST_F(mapped_file_tests, missing_file) {
+	mapped_file mf;
+	ASSERT_FALSE(mf.open(TEST_DIR + "/nonexistent.bin"));
+	ASSERT_FALSE(mf.is_open());
+	ASSERT_TRUE(mf.view(0, 1).empty());
+}
+
+TEST_F(mapped_file_tests, empty_file) {
+	{
+		std::ofstream f(TEST_DIR + "/empty.bin");
+	}
+	mapped_file mf;
+	ASSERT_TRUE(mf.open(TEST_DIR + "/empty.bin"));
+	ASSERT_EQ(0u, mf.size());
+	ASSERT_TRUE(mf.view(0, 0).empty());
+}
+
+TEST_F(mapped_file_tests, move) {
+	mapped_file original;
+	ASSERT_TRUE(original.open(TEST_DIR + "/data.bin"));
+	const uint8_t* data = original.data();
+
+	mapped_file mf(std::move(original));
+	ASSERT_FALSE(original.is_open());
+	ASSERT_TRUE(mf.is_open());
+	ASSERT_EQ(data, mf.data());
+	ASSERT_EQ('0', mf.view(0, 1)[0]);
+}
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <charconv>
 
 static operation_type string_to_operation_type(const std::string&& arg) {
 	// Possible values:
@@ -11,6 +12,8 @@ static operation_type string_to_operation_type(const std::string&& arg) {
 	//  x extract-all  > EXTRACT_ALL
 	//  r replace-file > REPLACE_FILE
 	//  c p build-package > BUILD_PACKAGE
+	//  s search       > SEARCH
+	//  l ls           > LIST_DIR
 
 	// First check for short argument
 	if (arg.length() == 1) {
@@ -30,6 +33,8 @@ static operation_type string_to_operation_type(const std::string&& arg) {
 			return BUILD_PACKAGE;
 		case 's':
 			return SEARCH;
+		case 'l':
+			return LIST_DIR;
 		case 'k':
 			return PACK_FILE;
 		case 'u':
@@ -64,6 +69,8 @@ static operation_type string_to_operation_type(const std::string&& arg) {
 		return BUILD_PACKAGE;
 	} else if (arg.substr(0, 6) == "search") {
 		return SEARCH;
+	} else if (arg == "ls" || arg.substr(0, 4) == "list") {
+		return LIST_DIR;
 	} else if (arg.substr(0, 4) == "pack" && arg.substr(5, 4) == "file") {
 		return PACK_FILE;
 	} else if (arg.substr(0, 6) == "unpack" && arg.substr(7, 4) == "file") {
@@ -76,6 +83,9 @@ static option_type read_option(const std::string& arg) {
 	//  -o  --output-path  > OUT_PATH
 	//  -i  --input-file   > IN_FILE
 	//  -f  --package-file > PACKAGE_FILE
+	//      --buffer-size  > BUFFER_SIZE
+	//  -j  --jobs         > JOBS
+	//  -b  --batch        > BATCH_FILE
 
 	if (arg.length() == 2) {
 		switch (arg[1]) {
@@ -85,6 +95,10 @@ static option_type read_option(const std::string& arg) {
 			return IN_PATH;
 		case 'f':
 			return PACKAGE_FILE;
+		case 'j':
+			return JOBS;
+		case 'b':
+			return BATCH_FILE;
 		default:
 			return INVALID_OPTION;
 		}
@@ -96,10 +110,44 @@ static option_type read_option(const std::string& arg) {
 		return IN_PATH;
 	} else if (arg.substr(2, 7) == "package" && arg.substr(10, 4) == "file") {
 		return PACKAGE_FILE;
+	} else if (arg.substr(2, 6) == "buffer" && arg.substr(9, 4) == "size") {
+		return BUFFER_SIZE;
+	} else if (arg.substr(2, 4) == "jobs") {
+		return JOBS;
+	} else if (arg.substr(2, 5) == "batch") {
+		return BATCH_FILE;
 	}
 	return INVALID_OPTION;
 }
 
+// Read a size in bytes, with an optional K, M or G suffix. Returns 0 if the size is not valid
+// or more than MAX_BUFFER_SIZE.
+static size_t read_size(const std::string& arg) {
+	size_t value = 0;
+	auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+	if (ec != std::errc() || value == 0) {
+		return 0;
+	}
+
+	std::string suffix(end, arg.data() + arg.size());
+	size_t mult = 0;
+	if (suffix.empty()) {
+		mult = 1;
+	} else if (suffix == "K" || suffix == "k") {
+		mult = 1024;
+	} else if (suffix == "M" || suffix == "m") {
+		mult = 1024 * 1024;
+	} else if (suffix == "G" || suffix == "g") {
+		mult = 1024 * 1024 * 1024;
+	}
+
+	// Checked before multiplying, so a huge value can't wrap around to a small one
+	if (mult == 0 || value > operation::MAX_BUFFER_SIZE / mult) {
+		return 0;
+	}
+	return value * mult;
+}
+
 static inline std::string read_param(int argc, char** argv, int idx) {
 	if (idx >= argc) {
 		return "";
@@ -122,11 +170,43 @@ bool operation::parse(int argc, char** argv) {
 		std::string param = read_param(argc, argv, arg_idx);
 
 		if (param[0] == '-') {
-			// Check for --pck flag first
+			// Check for flags without a parameter first
 			if (param == "--pck") {
 				m_pck_flag = true;
 				continue;
 			}
+			if (param == "--mmap") {
+				m_mmap_flag = true;
+				continue;
+			}
+			if (param == "--cache") {
+				m_cache_flag = true;
+				continue;
+			}
+			if (param == "--ignore-case") {
+				m_ignore_case_flag = true;
+				continue;
+			}
+			if (param == "--io-uring") {
+				m_io_uring_flag = true;
+				continue;
+			}
+			if (param == "--drop-cache") {
+				m_drop_cache_flag = true;
+				continue;
+			}
+			if (param == "--overrides") {
+				m_overrides_flag = true;
+				continue;
+			}
+			if (param == "--glob") {
+				m_glob_flag = true;
+				continue;
+			}
+			if (param == "--regex") {
+				m_regex_flag = true;
+				continue;
+			}
 
 			option_type opt = read_option(param);
 			switch (opt) {
@@ -148,6 +228,28 @@ bool operation::parse(int argc, char** argv) {
 				}
 				m_cat_filename = read_param(argc, argv, ++arg_idx);
 				break;
+			case BUFFER_SIZE:
+				m_buffer_size = read_size(read_param(argc, argv, ++arg_idx));
+				if (m_buffer_size == 0) {
+					std::cerr << "Invalid buffer size\n";
+					return false;
+				}
+				break;
+			case JOBS: {
+				std::string jobs = read_param(argc, argv, ++arg_idx);
+				auto [end, ec] = std::from_chars(jobs.data(), jobs.data() + jobs.size(), m_jobs);
+				if (ec != std::errc() || end != jobs.data() + jobs.size() || m_jobs == 0) {
+					std::cerr << "Invalid number of jobs\n";
+					return false;
+				}
+			} break;
+			case BATCH_FILE:
+				m_batch_filename = read_param(argc, argv, ++arg_idx);
+				if (m_batch_filename.empty()) {
+					std::cerr << "No batch file given (use - for standard input)\n";
+					return false;
+				}
+				break;
 			case INVALID_OPTION:
 				return false;
 			}
@@ -161,5 +263,10 @@ bool operation::parse(int argc, char** argv) {
 		}
 	}
 
+	if (m_glob_flag && m_regex_flag) {
+		std::cerr << "A pattern can't be both a glob and a regular expression\n";
+		return false;
+	}
+
 	return true;
 }
@@ -12,6 +12,7 @@ enum operation_type {
 	EXTRACT_ALL,
 	BUILD_PACKAGE,
 	SEARCH,
+	LIST_DIR,
 	PACK_FILE,
 	UNPACK_FILE,
 };
@@ -21,6 +22,9 @@ enum option_type {
 	OUT_PATH,
 	IN_PATH,
 	PACKAGE_FILE,
+	BUFFER_SIZE,
+	JOBS,
+	BATCH_FILE,
 };
 
 class operation {
@@ -39,6 +43,30 @@ public:
 	const std::filesystem::path& get_input_filename() const { return m_input_filename; }
 	/** pck flag => whether to automatically unpack .pck files during extraction */
 	bool get_pck_flag() const { return m_pck_flag; }
+	/** mmap flag => whether to memory-map .dat files instead of reading them */
+	bool get_mmap_flag() const { return m_mmap_flag; }
+	/** cache flag => whether to keep a cache of the catalog indexes in the data directory */
+	bool get_cache_flag() const { return m_cache_flag; }
+	/** ignore case flag => whether to match paths inside archives the way the game does */
+	bool get_ignore_case_flag() const { return m_ignore_case_flag; }
+	/** glob flag => whether the search filename is a glob pattern */
+	bool get_glob_flag() const { return m_glob_flag; }
+	/** regex flag => whether the search filename is a regular expression */
+	bool get_regex_flag() const { return m_regex_flag; }
+	/** io_uring flag => whether to extract through io_uring where the kernel has it */
+	bool get_io_uring_flag() const { return m_io_uring_flag; }
+	/** drop cache flag => whether to keep extracted data out of the page cache */
+	bool get_drop_cache_flag() const { return m_drop_cache_flag; }
+	/** overrides flag => whether search also lists the older versions of the file it found */
+	bool get_overrides_flag() const { return m_overrides_flag; }
+	/** buffer size => size of the blocks to stream extracted files in, or 0 for the default */
+	size_t get_buffer_size() const { return m_buffer_size; }
+	/** Largest buffer size that is accepted; every file being extracted may hold one */
+	static constexpr size_t MAX_BUFFER_SIZE = 1024 * 1024 * 1024; // 1 GB
+	/** batch filename => file with one name per line to search for, or "-" for stdin */
+	const std::filesystem::path& get_batch_filename() const { return m_batch_filename; }
+	/** jobs => number of worker threads to extract with */
+	unsigned get_jobs() const { return m_jobs; }
 
 private:
 	operation_type m_type;
@@ -46,5 +74,16 @@ private:
 	std::filesystem::path m_src_filename;
 	std::filesystem::path m_dst_path;
 	std::filesystem::path m_input_filename;
+	std::filesystem::path m_batch_filename;
 	bool m_pck_flag = false;
+	bool m_mmap_flag = false;
+	bool m_cache_flag = false;
+	bool m_ignore_case_flag = false;
+	bool m_glob_flag = false;
+	bool m_regex_flag = false;
+	bool m_io_uring_flag = false;
+	bool m_drop_cache_flag = false;
+	bool m_overrides_flag = false;
+	size_t m_buffer_size = 0;
+	unsigned m_jobs = 1;
 };
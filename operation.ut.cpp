@@ -362,6 +362,178 @@ TEST(operation_tests, mixed_option_ordering) {
 	ASSERT_EQ("out.txt", op.get_dest_path());
 }
 
+TEST(operation_tests, mmap_flag) {
+	ArgvHelper args({"x3tool", "x", "test.cat", "--mmap", "-o", "out"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_EQ(EXTRACT_ARCHIVE, op.get_type());
+	ASSERT_TRUE(op.get_mmap_flag());
+	ASSERT_FALSE(op.get_pck_flag());
+	ASSERT_EQ("out", op.get_dest_path());
+}
+
+TEST(operation_tests, mmap_flag_default_off) {
+	ArgvHelper args({"x3tool", "x", "test.cat"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_FALSE(op.get_mmap_flag());
+}
+
+TEST(operation_tests, cache_flag) {
+	ArgvHelper args({"x3tool", "s", "-i", "data", "-f", "ship.mdl", "--cache"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_EQ(SEARCH, op.get_type());
+	ASSERT_TRUE(op.get_cache_flag());
+	ASSERT_EQ("ship.mdl", op.get_internal_filename());
+}
+
+TEST(operation_tests, overrides_flag) {
+	ArgvHelper args({"x3tool", "s", "-i", "data", "-f", "ship.mdl", "--overrides"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_EQ(SEARCH, op.get_type());
+	ASSERT_TRUE(op.get_overrides_flag());
+	ASSERT_FALSE(op.get_cache_flag());
+}
+
+TEST(operation_tests, ignore_case_flag) {
+	ArgvHelper args({"x3tool", "f", "test.cat", "-f", "Models\\Ship.mdl", "--ignore-case"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_TRUE(op.get_ignore_case_flag());
+	ASSERT_FALSE(op.get_cache_flag());
+	ASSERT_EQ("Models\\Ship.mdl", op.get_internal_filename());
+}
+
+TEST(operation_tests, batch_search) {
+	ArgvHelper args({"x3tool", "s", "-i", "data", "--batch", "-", "-j", "4"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_EQ(SEARCH, op.get_type());
+	ASSERT_EQ("-", op.get_batch_filename());
+	ASSERT_EQ(4u, op.get_jobs());
+
+	ArgvHelper missing({"x3tool", "s", "-i", "data", "-b"});
+	ASSERT_FALSE(op.parse(missing.argc(), missing.argv()));
+}
+
+TEST(operation_tests, pattern_flags) {
+	ArgvHelper glob({"x3tool", "s", "-i", "data", "-f", "types/*.pck", "--glob"});
+	operation op;
+	ASSERT_TRUE(op.parse(glob.argc(), glob.argv()));
+	ASSERT_TRUE(op.get_glob_flag());
+	ASSERT_FALSE(op.get_regex_flag());
+
+	ArgvHelper both({"x3tool", "s", "-i", "data", "-f", "x", "--glob", "--regex"});
+	operation op2;
+	ASSERT_FALSE(op2.parse(both.argc(), both.argv()));
+}
+
+TEST(operation_tests, extraction_flags) {
+	ArgvHelper args({"x3tool", "a", "-i", "data", "-o", "out", "--io-uring", "--drop-cache"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_TRUE(op.get_io_uring_flag());
+	ASSERT_TRUE(op.get_drop_cache_flag());
+	ASSERT_FALSE(op.get_mmap_flag());
+}
+
+TEST(operation_tests, list_dir) {
+	for (const char* name : {"l", "ls", "list"}) {
+		ArgvHelper args({"x3tool", name, "-i", "data", "-f", "models"});
+		operation op;
+
+		ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+		ASSERT_EQ(LIST_DIR, op.get_type());
+		ASSERT_EQ("data", op.get_src_filename());
+		ASSERT_EQ("models", op.get_internal_filename());
+	}
+}
+
+TEST(operation_tests, buffer_size) {
+	ArgvHelper args({"x3tool", "x", "test.cat", "--buffer-size", "4096"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(args.argc(), args.argv()));
+	ASSERT_EQ(4096u, op.get_buffer_size());
+}
+
+TEST(operation_tests, buffer_size_suffixes) {
+	ArgvHelper kb({"x3tool", "x", "test.cat", "--buffer-size", "64K"});
+	ArgvHelper mb({"x3tool", "a", "-i", "in", "-o", "out", "--buffer_size", "4M"});
+	operation op_kb;
+	operation op_mb;
+
+	ASSERT_TRUE(op_kb.parse(kb.argc(), kb.argv()));
+	ASSERT_EQ(64u * 1024, op_kb.get_buffer_size());
+	ASSERT_TRUE(op_mb.parse(mb.argc(), mb.argv()));
+	ASSERT_EQ(4u * 1024 * 1024, op_mb.get_buffer_size());
+}
+
+TEST(operation_tests, buffer_size_default_and_invalid) {
+	ArgvHelper none({"x3tool", "x", "test.cat"});
+	ArgvHelper zero({"x3tool", "x", "test.cat", "--buffer-size", "0"});
+	ArgvHelper junk({"x3tool", "x", "test.cat", "--buffer-size", "12Q"});
+	ArgvHelper missing({"x3tool", "x", "test.cat", "--buffer-size"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(none.argc(), none.argv()));
+	ASSERT_EQ(0u, op.get_buffer_size());
+	ASSERT_FALSE(operation().parse(zero.argc(), zero.argv()));
+	ASSERT_FALSE(operation().parse(junk.argc(), junk.argv()));
+	ASSERT_FALSE(operation().parse(missing.argc(), missing.argv()));
+}
+
+TEST(operation_tests, buffer_size_limits) {
+	// 17179869184G is 2^64 bytes, which would wrap around to 0
+	ArgvHelper wraps({"x3tool", "x", "test.cat", "--buffer-size", "17179869184G"});
+	ArgvHelper huge({"x3tool", "x", "test.cat", "--buffer-size", "100G"});
+	ArgvHelper bytes({"x3tool", "x", "test.cat", "--buffer-size", "1073741825"});
+	ArgvHelper max({"x3tool", "x", "test.cat", "--buffer-size", "1G"});
+	operation op;
+
+	ASSERT_FALSE(operation().parse(wraps.argc(), wraps.argv()));
+	ASSERT_FALSE(operation().parse(huge.argc(), huge.argv()));
+	ASSERT_FALSE(operation().parse(bytes.argc(), bytes.argv()));
+	ASSERT_TRUE(op.parse(max.argc(), max.argv()));
+	ASSERT_EQ(operation::MAX_BUFFER_SIZE, op.get_buffer_size());
+}
+
+TEST(operation_tests, jobs) {
+	ArgvHelper short_args({"x3tool", "x", "test.cat", "-j", "8"});
+	ArgvHelper long_args({"x3tool", "x", "test.cat", "--jobs", "3", "-o", "out"});
+	operation op_short;
+	operation op_long;
+
+	ASSERT_TRUE(op_short.parse(short_args.argc(), short_args.argv()));
+	ASSERT_EQ(8u, op_short.get_jobs());
+	ASSERT_TRUE(op_long.parse(long_args.argc(), long_args.argv()));
+	ASSERT_EQ(3u, op_long.get_jobs());
+	ASSERT_EQ("out", op_long.get_dest_path());
+}
+
+TEST(operation_tests, jobs_default_and_invalid) {
+	ArgvHelper none({"x3tool", "x", "test.cat"});
+	ArgvHelper zero({"x3tool", "x", "test.cat", "-j", "0"});
+	ArgvHelper junk({"x3tool", "x", "test.cat", "-j", "4x"});
+	ArgvHelper missing({"x3tool", "x", "test.cat", "-j"});
+	operation op;
+
+	ASSERT_TRUE(op.parse(none.argc(), none.argv()));
+	ASSERT_EQ(1u, op.get_jobs());
+	ASSERT_FALSE(operation().parse(zero.argc(), zero.argv()));
+	ASSERT_FALSE(operation().parse(junk.argc(), junk.argv()));
+	ASSERT_FALSE(operation().parse(missing.argc(), missing.argv()));
+}
+
 int main(int argc, char** argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
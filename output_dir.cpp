@@ -0,0 +1,213 @@
+#include "output_dir.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+output_file& output_file::operator=(output_file&& other) noexcept {
+	if (this != &other) {
+		close();
+		m_fd = other.m_fd;
+		other.m_fd = -1;
+	}
+	return *this;
+}
+
+bool output_file::write(const uint8_t* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = ::write(m_fd, data, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool output_file::truncate() {
+	return ftruncate(m_fd, 0) == 0 && lseek(m_fd, 0, SEEK_SET) == 0;
+}
+
+void output_file::preallocate(uint64_t size) {
+	// Unlike posix_fallocate, this never falls back to writing zeroes over the whole file
+	if (size > 0) {
+		fallocate(m_fd, 0, 0, size);
+	}
+}
+
+void output_file::drop_cache() {
+	// Dirty pages can't be dropped, so they have to be written first
+	sync_file_range(m_fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(m_fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+bool output_file::close() {
+	if (m_fd < 0) {
+		return true;
+	}
+	int ret = ::close(m_fd);
+	m_fd = -1;
+	return ret == 0;
+}
+
+dir_handle::~dir_handle() {
+	if (m_fd >= 0) {
+		::close(m_fd);
+	}
+}
+
+output_dir::output_dir(const std::filesystem::path& root, size_t max_dirs)
+	: m_root_path(root), m_max_dirs(std::max<size_t>(max_dirs, 1)) {
+	std::error_code err;
+	if (!std::filesystem::create_directories(root, err) && err.value() != 0) {
+		std::cerr << "Failed to create directory " << root << ": " << err << std::endl;
+		return;
+	}
+	int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		std::cerr << "Could not open directory " << root << ": " << strerror(errno) << std::endl;
+		return;
+	}
+	m_root = std::make_shared<dir_handle>(fd);
+}
+
+std::shared_ptr<dir_handle> output_dir::open_dir(std::string_view dir, std::string& rest) {
+	rest.clear();
+	if (dir.empty()) {
+		return m_root;
+	}
+	{
+		std::shared_lock lock(m_mutex);
+		auto it = m_dirs.find(std::string(dir));
+		if (it != m_dirs.end()) {
+			it->second.last_used = ++m_clock;
+			return it->second.handle;
+		}
+	}
+
+	std::unique_lock lock(m_mutex);
+	return open_dir_locked(dir, rest);
+}
+
+std::shared_ptr<dir_handle> output_dir::open_dir_locked(std::string_view dir, std::string& rest) {
+	rest.clear();
+	if (dir.empty()) {
+		return m_root;
+	}
+	std::string key(dir);
+	auto it = m_dirs.find(key);
+	if (it != m_dirs.end()) {
+		it->second.last_used = ++m_clock;
+		return it->second.handle;
+	}
+
+	// Make sure the parent is there first, then make this one inside it
+	size_t slash = dir.rfind('/');
+	std::shared_ptr<dir_handle> parent =
+		open_dir_locked(slash == std::string_view::npos ? std::string_view() : dir.substr(0, slash), rest);
+	std::string_view name = slash == std::string_view::npos ? dir : dir.substr(slash + 1);
+	if (!parent || name.empty()) {
+		// Doubled slashes just mean the same directory
+		return parent;
+	}
+
+	// If the parent couldn't be opened, rest leads to it from the closest directory that could
+	bool through_parent = rest.empty();
+	if (!through_parent) {
+		rest += '/';
+	}
+	rest += name;
+	if (mkdirat(parent->fd(), rest.c_str(), 0777) != 0 && errno != EEXIST) {
+		std::cerr << "Failed to create directory " << m_root_path / dir << ": " << strerror(errno) << std::endl;
+		return nullptr;
+	}
+	if (!through_parent) {
+		return parent;
+	}
+
+	int fd = openat(parent->fd(), rest.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno == EMFILE || errno == ENFILE) {
+			// Files can still be made through the parent
+			return parent;
+		}
+		std::cerr << "Could not open directory " << m_root_path / dir << ": " << strerror(errno) << std::endl;
+		return nullptr;
+	}
+	rest.clear();
+
+	if (m_dirs.size() >= m_max_dirs) {
+		evict_locked();
+	}
+	cached_dir& cached = m_dirs[std::move(key)];
+	cached.handle = std::make_shared<dir_handle>(fd);
+	cached.last_used = ++m_clock;
+	return cached.handle;
+}
+
+void output_dir::evict_locked() {
+	// A scan, but only when a new directory is opened, which costs a lot more anyway.
+	// Anyone still using the directory keeps it open until they're done.
+	auto oldest = std::min_element(m_dirs.begin(), m_dirs.end(), [](const auto& a, const auto& b) {
+		return a.second.last_used < b.second.last_used;
+	});
+	if (oldest != m_dirs.end()) {
+		m_dirs.erase(oldest);
+	}
+}
+
+std::shared_ptr<dir_handle> output_dir::parent_dir(std::string_view relpath, std::string& name) {
+	size_t slash = relpath.rfind('/');
+	std::string_view filename = slash == std::string_view::npos ? relpath : relpath.substr(slash + 1);
+	std::shared_ptr<dir_handle> dir =
+		open_dir(slash == std::string_view::npos ? std::string_view() : relpath.substr(0, slash), name);
+	if (!name.empty()) {
+		name += '/';
+	}
+	name += filename;
+	return dir;
+}
+
+output_file output_dir::create(std::string_view relpath) {
+	std::string name;
+	std::shared_ptr<dir_handle> dir = parent_dir(relpath, name);
+	if (!dir) {
+		return output_file();
+	}
+
+	const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	int fd = openat(dir->fd(), name.c_str(), flags, 0666);
+	if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+		// Give back the directories being kept open, and go in from the root instead
+		dir.reset();
+		{
+			std::unique_lock lock(m_mutex);
+			m_dirs.clear();
+		}
+		fd = openat(m_root->fd(), std::string(relpath).c_str(), flags, 0666);
+	}
+	if (fd < 0) {
+		std::cerr << "Could not open output file " << m_root_path / relpath << " for writing: " << strerror(errno)
+		          << std::endl;
+	}
+	return output_file(fd);
+}
+
+bool output_dir::remove(std::string_view relpath) {
+	std::string name;
+	std::shared_ptr<dir_handle> dir = parent_dir(relpath, name);
+	if (!dir) {
+		return false;
+	}
+	return unlinkat(dir->fd(), name.c_str(), 0) == 0 || errno == ENOENT;
+}
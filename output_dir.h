@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * A file opened for writing by output_dir. Closed when the object goes away.
+ */
+class output_file {
+public:
+	output_file() {}
+	explicit output_file(int fd) : m_fd(fd) {}
+	~output_file() { close(); }
+
+	output_file(output_file&& other) noexcept : m_fd(other.m_fd) { other.m_fd = -1; }
+	output_file& operator=(output_file&& other) noexcept;
+	output_file(const output_file&) = delete;
+	output_file& operator=(const output_file&) = delete;
+
+	/**
+	 * Write all of data at the current position. Returns false on error.
+	 */
+	bool write(const uint8_t* data, size_t size);
+
+	/**
+	 * Throw away everything written so far and start again at the beginning.
+	 */
+	bool truncate();
+
+	/**
+	 * Reserve space for the whole file before writing it, so it isn't grown one write at a
+	 * time. This is only a hint; filesystems that can't do it are left alone.
+	 */
+	void preallocate(uint64_t size);
+
+	/**
+	 * Write out what has been written so far and drop it from the page cache, for files
+	 * nobody is going to read soon. Waits for the data to reach the disk.
+	 */
+	void drop_cache();
+
+	/**
+	 * Close the file. Returns false if that failed, which can be where a write error turns up.
+	 */
+	bool close();
+
+	bool is_open() const { return m_fd >= 0; }
+
+private:
+	int m_fd = -1;
+};
+
+/**
+ * An open directory. The descriptor is closed when the last reference to it goes, so an
+ * output_dir can stop caching a directory while someone is still creating a file in it.
+ */
+class dir_handle {
+public:
+	explicit dir_handle(int fd) : m_fd(fd) {}
+	~dir_handle();
+
+	dir_handle(const dir_handle&) = delete;
+	dir_handle& operator=(const dir_handle&) = delete;
+
+	int fd() const { return m_fd; }
+
+private:
+	int m_fd;
+};
+
+/**
+ * Creates files under one output directory.
+ *
+ * Directories are made the first time a file needs them, and the most recently used ones
+ * are kept open, so each later file in them is created with a single openat() and no path
+ * walk or stat. Once max_dirs are open, or the process runs out of descriptors, files go
+ * in through the closest directory that is open instead.
+ * Any number of threads may create files at once.
+ */
+class output_dir {
+public:
+	/** Default for how many directories are kept open at once */
+	static constexpr size_t MAX_OPEN_DIRS = 256;
+
+	/**
+	 * Use root as the output directory, creating it if needed. Check is_open() afterwards.
+	 */
+	explicit output_dir(const std::filesystem::path& root, size_t max_dirs = MAX_OPEN_DIRS);
+
+	output_dir(const output_dir&) = delete;
+	output_dir& operator=(const output_dir&) = delete;
+
+	bool is_open() const { return m_root != nullptr; }
+
+	/**
+	 * Create (or truncate) a file at a '/'-separated path under the root, along with any
+	 * directories it's in. Returns a closed output_file, after printing why, on error.
+	 */
+	output_file create(std::string_view relpath);
+
+	/**
+	 * Delete a file created under the root, e.g. one that couldn't be written in full.
+	 * Returns false if it couldn't be removed.
+	 */
+	bool remove(std::string_view relpath);
+
+	/**
+	 * Get a directory to create the file at relpath in, creating the directories it's in if
+	 * needed, so the file can be created some other way (e.g. through io_uring). name is set
+	 * to the file's path relative to that directory, which is usually just its name.
+	 * Returns nullptr on error.
+	 */
+	std::shared_ptr<dir_handle> parent_dir(std::string_view relpath, std::string& name);
+
+	const std::filesystem::path& root() const { return m_root_path; }
+
+private:
+	struct cached_dir {
+		std::shared_ptr<dir_handle> handle;
+		std::atomic<uint64_t> last_used{0};
+	};
+
+	std::shared_ptr<dir_handle> open_dir(std::string_view dir, std::string& rest);
+	std::shared_ptr<dir_handle> open_dir_locked(std::string_view dir, std::string& rest);
+	void evict_locked();
+
+	std::filesystem::path m_root_path;
+	std::shared_ptr<dir_handle> m_root;
+	size_t m_max_dirs;
+	// Open directories, by path under the root, and when each was last used
+	std::shared_mutex m_mutex;
+	std::unordered_map<std::string, cached_dir> m_dirs;
+	std::atomic<uint64_t> m_clock{0};
+};
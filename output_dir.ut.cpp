@@ -0,0 +1,161 @@
+#include "output_dir.h"
+#include "test_utils.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+static const std::string TEST_DIR = "test_output_dir";
+
+class output_dir_tests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+};
+
+static bool write_string(output_file& file, const std::string& contents) {
+	return file.write((const uint8_t*)contents.data(), contents.size());
+}
+
+TEST_F(output_dir_tests, create) {
+	// The root is created along with the directories under it
+	output_dir out(TEST_DIR + "/root");
+	ASSERT_TRUE(out.is_open());
+
+	output_file file = out.create("a/b/c.txt");
+	ASSERT_TRUE(file.is_open());
+	ASSERT_TRUE(write_string(file, "hello"));
+	ASSERT_TRUE(file.close());
+	ASSERT_EQ("hello", test_utils::read_file(TEST_DIR + "/root/a/b/c.txt"));
+
+	file = out.create("top.txt");
+	ASSERT_TRUE(write_string(file, "top"));
+	ASSERT_TRUE(file.close());
+	ASSERT_EQ("top", test_utils::read_file(TEST_DIR + "/root/top.txt"));
+
+	// Creating a file again replaces it, and directories that are already there are fine
+	file = out.create("a/b/c.txt");
+	ASSERT_TRUE(write_string(file, "bye"));
+	ASSERT_TRUE(file.close());
+	ASSERT_EQ("bye", test_utils::read_file(TEST_DIR + "/root/a/b/c.txt"));
+
+	output_dir again(TEST_DIR + "/root");
+	file = again.create("a//b/d.txt");
+	ASSERT_TRUE(write_string(file, "d"));
+	ASSERT_TRUE(file.close());
+	ASSERT_EQ("d", test_utils::read_file(TEST_DIR + "/root/a/b/d.txt"));
+}
+
+TEST_F(output_dir_tests, truncate) {
+	output_dir out(TEST_DIR);
+	output_file file = out.create("file.txt");
+	ASSERT_TRUE(write_string(file, "first attempt"));
+	ASSERT_TRUE(file.truncate());
+	ASSERT_TRUE(write_string(file, "second"));
+	ASSERT_TRUE(file.close());
+	ASSERT_EQ("second", test_utils::read_file(TEST_DIR + "/file.txt"));
+}
+
+TEST_F(output_dir_tests, remove) {
+	output_dir out(TEST_DIR);
+	output_file file = out.create("a/b/partial.txt");
+	ASSERT_TRUE(write_string(file, "half"));
+	ASSERT_TRUE(file.close());
+
+	ASSERT_TRUE(out.remove("a/b/partial.txt"));
+	ASSERT_FALSE(std::filesystem::exists(TEST_DIR + "/a/b/partial.txt"));
+	// Nothing to remove is fine too
+	ASSERT_TRUE(out.remove("a/b/partial.txt"));
+}
+
+TEST_F(output_dir_tests, errors) {
+	output_dir out(TEST_DIR);
+	output_file file = out.create("blocker");
+	ASSERT_TRUE(file.close());
+
+	// A file is in the way of the directory
+	ASSERT_FALSE(out.create("blocker/file.txt").is_open());
+	ASSERT_FALSE(out.create("dir/").is_open());
+}
+
+static size_t open_fds() {
+	size_t count = 0;
+	for ([[maybe_unused]] const auto& fd : std::filesystem::directory_iterator("/proc/self/fd")) {
+		++count;
+	}
+	return count;
+}
+
+TEST_F(output_dir_tests, many_dirs) {
+	// More directories than are kept open; the least recently used ones are closed
+	size_t before = open_fds();
+	output_dir out(TEST_DIR, 4);
+	for (int i = 0; i < 40; ++i) {
+		std::string name = "d" + std::to_string(i) + "/sub/" + std::to_string(i);
+		output_file file = out.create(name);
+		ASSERT_TRUE(file.is_open() && write_string(file, name) && file.close()) << name;
+		// The root and up to 4 directories
+		ASSERT_LE(open_fds(), before + 5);
+	}
+	for (int i = 0; i < 40; ++i) {
+		std::string name = "d" + std::to_string(i) + "/sub/" + std::to_string(i);
+		ASSERT_EQ(name, test_utils::read_file(TEST_DIR + "/" + name));
+	}
+}
+
+TEST_F(output_dir_tests, out_of_descriptors) {
+	output_dir out(TEST_DIR);
+	ASSERT_TRUE(out.is_open());
+
+	// Leave room for one more descriptor: enough for the file, but not its directories as well
+	int lowest = dup(0);
+	ASSERT_GE(lowest, 0);
+	close(lowest);
+	rlimit old_limit;
+	ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &old_limit));
+	rlimit limit = old_limit;
+	limit.rlim_cur = lowest + 1;
+	ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+
+	output_file file = out.create("a/b/c/file.txt");
+	bool opened = file.is_open() && write_string(file, "deep") && file.close();
+	file = out.create("a/b/c/other.txt");
+	opened = opened && file.is_open() && write_string(file, "other") && file.close();
+	setrlimit(RLIMIT_NOFILE, &old_limit);
+
+	ASSERT_TRUE(opened);
+	ASSERT_EQ("deep", test_utils::read_file(TEST_DIR + "/a/b/c/file.txt"));
+	ASSERT_EQ("other", test_utils::read_file(TEST_DIR + "/a/b/c/other.txt"));
+}
+
+TEST_F(output_dir_tests, threads) {
+	output_dir out(TEST_DIR);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&out, t] {
+			for (int i = 0; i < 50; ++i) {
+				std::string name = "d" + std::to_string(i % 5) + "/e" + std::to_string(i % 3) + "/" +
+				                   std::to_string(t) + "_" + std::to_string(i);
+				output_file file = out.create(name);
+				EXPECT_TRUE(file.is_open() && write_string(file, name) && file.close()) << name;
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	ASSERT_EQ("d4/e1/3_49", test_utils::read_file(TEST_DIR + "/d4/e1/3_49"));
+}
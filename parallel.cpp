@@ -0,0 +1,153 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <thread>
+#include <vector>
+
+void run_workers(unsigned jobs, const std::function<void(unsigned worker)>& fn) {
+	std::vector<std::thread> threads;
+	for (unsigned worker = 1; worker < jobs; ++worker) {
+		threads.emplace_back(fn, worker);
+	}
+
+	fn(0);
+
+	for (auto& t : threads) {
+		t.join();
+	}
+}
+
+namespace {
+
+// The work one worker has left; other workers take from the back
+struct range_queue {
+	std::mutex lock;
+	std::deque<work_range> ranges;
+	std::atomic<size_t> remaining{0}; // Only changed with lock held, read without it as a hint
+};
+
+size_t length(const work_range& r) {
+	return r.second - r.first;
+}
+
+bool take(range_queue& q, size_t& index) {
+	std::lock_guard<std::mutex> guard(q.lock);
+	if (q.ranges.empty()) {
+		return false;
+	}
+
+	work_range& front = q.ranges.front();
+	index = front.first++;
+	if (front.first == front.second) {
+		q.ranges.pop_front();
+	}
+	q.remaining--;
+	return true;
+}
+
+bool steal(std::vector<range_queue>& queues, unsigned thief) {
+	// Try the busiest workers first. The counts keep changing under us, so sort a snapshot
+	// of them; sorting on the live values wouldn't be a consistent ordering.
+	std::vector<std::pair<size_t, unsigned>> victims;
+	victims.reserve(queues.size());
+	for (unsigned v = 0; v < queues.size(); ++v) {
+		victims.emplace_back(queues[v].remaining.load(), v);
+	}
+	std::sort(victims.begin(), victims.end(), std::greater<>());
+
+	for (auto [remaining, v] : victims) {
+		if (v == thief || remaining == 0) {
+			continue;
+		}
+
+		work_range loot;
+		{
+			range_queue& victim = queues[v];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (victim.ranges.size() > 1) {
+				// A whole range the victim hasn't started on
+				loot = victim.ranges.back();
+				victim.ranges.pop_back();
+			} else if (!victim.ranges.empty() && length(victim.ranges.front()) > 1) {
+				// Split the one the victim is working on; it keeps the front half
+				work_range& current = victim.ranges.front();
+				size_t mid = current.first + (length(current) + 1) / 2;
+				loot = work_range(mid, current.second);
+				current.second = mid;
+			} else {
+				continue;
+			}
+			victim.remaining -= length(loot);
+		}
+
+		range_queue& own = queues[thief];
+		std::lock_guard<std::mutex> guard(own.lock);
+		own.ranges.push_back(loot);
+		own.remaining += length(loot);
+		return true;
+	}
+	return false;
+}
+
+}
+
+bool run_ranges(unsigned jobs,
+                const std::vector<work_range>& ranges,
+                const std::function<bool(unsigned worker, size_t index)>& fn,
+                const std::function<bool(unsigned worker)>& done) {
+	size_t total = 0;
+	for (const auto& r : ranges) {
+		total += length(r);
+	}
+	jobs = std::max<size_t>(1, std::min<size_t>(jobs, total));
+
+	// Deal the ranges out biggest first, each to whoever has the least work so far
+	std::vector<range_queue> queues(jobs);
+	std::vector<work_range> by_size(ranges);
+	std::stable_sort(by_size.begin(), by_size.end(), [](const work_range& a, const work_range& b) {
+		return length(a) > length(b);
+	});
+	for (const auto& r : by_size) {
+		if (length(r) == 0) {
+			continue;
+		}
+		auto q = std::min_element(queues.begin(), queues.end(), [](const range_queue& a, const range_queue& b) {
+			return a.remaining < b.remaining;
+		});
+		q->ranges.push_back(r);
+		q->remaining += length(r);
+	}
+
+	// Within a worker, keep the ranges in their original order
+	for (auto& q : queues) {
+		std::sort(q.ranges.begin(), q.ranges.end());
+	}
+
+	std::atomic<bool> failed(false);
+	run_workers(jobs, [&](unsigned worker) {
+		size_t index;
+		while (!failed) {
+			if (!take(queues[worker], index)) {
+				if (!steal(queues, worker)) {
+					// Nothing left anywhere that isn't already being worked on
+					break;
+				}
+				continue;
+			}
+
+			if (!fn(worker, index)) {
+				failed = true;
+			}
+		}
+
+		if (done && !done(worker)) {
+			failed = true;
+		}
+	});
+
+	return !failed;
+}
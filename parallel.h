@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * Run fn(worker) on the given number of worker threads and wait for all of them to finish.
+ *
+ * The calling thread acts as worker 0, so jobs <= 1 simply calls fn(0) with no
+ * threads involved. Workers are expected to share out the work among themselves.
+ */
+void run_workers(unsigned jobs, const std::function<void(unsigned worker)>& fn);
+
+/** A half-open range [first, second) of work item indexes */
+using work_range = std::pair<size_t, size_t>;
+
+/**
+ * Run fn(worker, index) for every index in the given ranges, on up to jobs threads.
+ *
+ * Each worker goes through the indexes it holds in order, so a range that should be
+ * processed front to back (like a run of files in one archive) mostly is. The ranges
+ * are dealt out up front, biggest first, and a worker that runs out of work steals the
+ * back half of what another worker has left.
+ *
+ * No more work is handed out once fn returns false, and run_ranges returns false.
+ *
+ * If given, done(worker) is called by each worker on its own thread once it runs out of
+ * work, e.g. to flush something it kept per thread. If done returns false, so does run_ranges.
+ */
+bool run_ranges(unsigned jobs,
+                const std::vector<work_range>& ranges,
+                const std::function<bool(unsigned worker, size_t index)>& fn,
+                const std::function<bool(unsigned worker)>& done = nullptr);
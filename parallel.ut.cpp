@@ -0,0 +1,166 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+TEST(parallel, runs_every_worker) {
+	std::mutex lock;
+	std::set<unsigned> seen;
+
+	run_workers(4, [&](unsigned worker) {
+		std::lock_guard<std::mutex> guard(lock);
+		seen.insert(worker);
+	});
+
+	ASSERT_EQ((std::set<unsigned>{0, 1, 2, 3}), seen);
+}
+
+TEST(parallel, single_job_runs_on_caller) {
+	for (unsigned jobs : {0u, 1u}) {
+		int calls = 0;
+		std::thread::id id;
+		run_workers(jobs, [&](unsigned worker) {
+			ASSERT_EQ(0u, worker);
+			id = std::this_thread::get_id();
+			calls++;
+		});
+
+		ASSERT_EQ(1, calls);
+		ASSERT_EQ(std::this_thread::get_id(), id);
+	}
+}
+
+TEST(parallel, shared_counter) {
+	std::atomic<int> next(0);
+	std::atomic<int> done(0);
+
+	run_workers(8, [&](unsigned) {
+		while (next++ < 1000) {
+			done++;
+		}
+	});
+
+	ASSERT_EQ(1000, done);
+}
+
+TEST(parallel, ranges_cover_every_index) {
+	std::vector<work_range> ranges = {{0, 10}, {10, 11}, {11, 11}, {11, 500}, {500, 520}};
+	std::vector<std::atomic<int>> hits(520);
+
+	ASSERT_TRUE(run_ranges(4, ranges, [&](unsigned, size_t index) {
+		hits[index]++;
+		return true;
+	}));
+
+	for (const auto& h : hits) {
+		ASSERT_EQ(1, h);
+	}
+}
+
+TEST(parallel, ranges_in_order_per_worker) {
+	// With one worker there's nobody to steal, so everything goes in order
+	std::vector<size_t> seen;
+	ASSERT_TRUE(run_ranges(1, {{5, 10}, {0, 5}}, [&](unsigned worker, size_t index) {
+		EXPECT_EQ(0u, worker);
+		seen.push_back(index);
+		return true;
+	}));
+
+	ASSERT_EQ((std::vector<size_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), seen);
+}
+
+TEST(parallel, ranges_are_stolen) {
+	// One big range only goes to one worker, so the others only get work by stealing from it
+	std::mutex lock;
+	std::set<unsigned> workers;
+
+	ASSERT_TRUE(run_ranges(4, {{0, 200}}, [&](unsigned worker, size_t) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			workers.insert(worker);
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		return true;
+	}));
+
+	ASSERT_GT(workers.size(), 1u);
+}
+
+TEST(parallel, ranges_stolen_by_many_workers) {
+	// More workers than std::sort handles with a plain insertion sort, all stealing from
+	// each other while the amount of work they have left keeps changing
+	std::vector<work_range> ranges;
+	size_t total = 0;
+	for (size_t i = 0; i < 24; ++i) {
+		size_t len = i % 3 == 0 ? 400 : i % 3 == 1 ? 1 : 37;
+		ranges.emplace_back(total, total + len);
+		total += len;
+	}
+	std::vector<std::atomic<int>> seen(total);
+
+	for (int round = 0; round < 20; ++round) {
+		for (auto& count : seen) {
+			count = 0;
+		}
+		ASSERT_TRUE(run_ranges(40, ranges, [&](unsigned, size_t index) {
+			seen[index]++;
+			return true;
+		}));
+		for (size_t i = 0; i < total; ++i) {
+			ASSERT_EQ(1, seen[i]) << i;
+		}
+	}
+}
+
+TEST(parallel, ranges_stop_on_failure) {
+	std::atomic<int> calls(0);
+
+	ASSERT_FALSE(run_ranges(1, {{0, 100}}, [&](unsigned, size_t index) {
+		calls++;
+		return index != 5;
+	}));
+
+	ASSERT_EQ(6, calls);
+}
+
+TEST(parallel, ranges_done_on_worker_thread) {
+	// Each worker's epilogue runs on the thread that did its work, after all of it
+	std::mutex lock;
+	std::vector<std::thread::id> worked(4);
+	std::vector<std::thread::id> finished(4);
+	std::atomic<int> calls(0);
+
+	ASSERT_TRUE(run_ranges(
+		4,
+		{{0, 100}},
+		[&](unsigned worker, size_t) {
+			std::lock_guard<std::mutex> guard(lock);
+			EXPECT_EQ(std::thread::id(), finished[worker]);
+			worked[worker] = std::this_thread::get_id();
+			calls++;
+			return true;
+		},
+		[&](unsigned worker) {
+			std::lock_guard<std::mutex> guard(lock);
+			finished[worker] = std::this_thread::get_id();
+			return true;
+		}));
+
+	ASSERT_EQ(100, calls);
+	for (unsigned worker = 0; worker < 4; ++worker) {
+		ASSERT_NE(std::thread::id(), finished[worker]);
+		if (worked[worker] != std::thread::id()) {
+			ASSERT_EQ(worked[worker], finished[worker]);
+		}
+	}
+
+	// A failing epilogue fails the whole run
+	ASSERT_FALSE(run_ranges(2, {{0, 10}}, [](unsigned, size_t) { return true; }, [](unsigned worker) {
+		return worker != 1;
+	}));
+}
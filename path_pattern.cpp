@@ -0,0 +1,117 @@
+#include "path_pattern.h"
+
+#include <cctype>
+#include <cstring>
+
+bool has_wildcards(std::string_view pattern) {
+	return pattern.find_first_of("*?[") != std::string_view::npos;
+}
+
+// Match a single character against the pattern element at p, and say how long the element is
+static bool match_one(std::string_view pattern, size_t p, char c, size_t& length) {
+	length = 1;
+	if (pattern[p] == '?') {
+		return true;
+	}
+	if (pattern[p] != '[') {
+		return pattern[p] == c;
+	}
+
+	size_t i = p + 1;
+	bool negate = i < pattern.size() && pattern[i] == '!';
+	if (negate) {
+		++i;
+	}
+	// A ']' straight after the opening bracket is part of the set
+	size_t close = pattern.find(']', i + 1);
+	if (i >= pattern.size() || close == std::string_view::npos) {
+		// Not a set after all, just a bracket
+		return c == '[';
+	}
+
+	bool found = false;
+	for (; i < close; ++i) {
+		if (i + 2 < close && pattern[i + 1] == '-') {
+			found = found || (c >= pattern[i] && c <= pattern[i + 2]);
+			i += 2;
+		} else {
+			found = found || c == pattern[i];
+		}
+	}
+	length = close + 1 - p;
+	return found != negate;
+}
+
+bool glob_match(std::string_view pattern, std::string_view name) {
+	size_t p = 0;
+	size_t n = 0;
+	size_t star = std::string_view::npos; // Where the last '*' was, to go back to if a match fails
+	size_t star_n = 0;                    // and how much of the name it had matched
+
+	while (n < name.size()) {
+		if (p < pattern.size() && pattern[p] == '*') {
+			star = p;
+			star_n = n;
+			++p;
+
+			// The text up to the next wildcard has to turn up somewhere, and searching for it
+			// directly is much quicker than trying every position one character at a time
+			std::string_view literal = pattern.substr(p, pattern.find_first_of("*?[", p) - p);
+			if (!literal.empty()) {
+				size_t at = name.find(literal, n);
+				if (at == std::string_view::npos) {
+					return false;
+				}
+				star_n = n = at;
+			}
+			continue;
+		}
+
+		size_t length;
+		if (p < pattern.size() && match_one(pattern, p, name[n], length)) {
+			p += length;
+			++n;
+			continue;
+		}
+
+		if (star == std::string_view::npos) {
+			return false;
+		}
+		// Let the last '*' swallow one more character and try again from there
+		p = star;
+		n = star_n + 1;
+	}
+
+	// Whatever is left of the pattern has to be able to match nothing
+	while (p < pattern.size() && pattern[p] == '*') {
+		++p;
+	}
+	return p == pattern.size();
+}
+
+std::string regex_literal_prefix(std::string_view regex) {
+	// With alternatives, matches don't have to share a prefix
+	if (regex.find('|') != std::string_view::npos) {
+		return "";
+	}
+
+	std::string prefix;
+	size_t i = regex.starts_with('^') ? 1 : 0;
+	for (; i < regex.size(); ++i) {
+		char c = regex[i];
+		if (c == '\\' && i + 1 < regex.size() && std::ispunct((unsigned char)regex[i + 1])) {
+			// An escaped punctuation character stands for itself
+			prefix += regex[++i];
+		} else if (strchr(".[](){}*+?^$|\\", c)) {
+			break;
+		} else {
+			prefix += c;
+		}
+	}
+
+	// A quantifier after the last character makes it optional
+	if (i < regex.size() && !prefix.empty() && (regex[i] == '?' || regex[i] == '*' || regex[i] == '{')) {
+		prefix.pop_back();
+	}
+	return prefix;
+}
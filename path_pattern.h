@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * Pattern matching for paths inside archives.
+ *
+ * Globs are matched one path component at a time, so the caller can walk a directory
+ * tree and skip whole directories that a component rules out.
+ */
+
+/**
+ * Whether a glob component has any wildcards in it, or is just a name.
+ */
+bool has_wildcards(std::string_view pattern);
+
+/**
+ * Match one path component against a glob component.
+ *
+ * '*' matches any run of characters, '?' any one character, and "[abc]", "[a-z]" or
+ * "[!abc]" one character from (or not from) a set. Everything else matches itself.
+ */
+bool glob_match(std::string_view pattern, std::string_view name);
+
+/**
+ * Get the literal text every match of a regular expression (ECMAScript syntax, matched
+ * against the whole string) has to start with. Returns an empty string if there is none,
+ * or if it can't be worked out simply, e.g. because of alternatives.
+ */
+std::string regex_literal_prefix(std::string_view regex);
@@ -0,0 +1,44 @@
+#include "path_pattern.h"
+
+#include <gtest/gtest.h>
+
+TEST(path_pattern, glob_match) {
+	ASSERT_TRUE(glob_match("ship.mdl", "ship.mdl"));
+	ASSERT_FALSE(glob_match("ship.mdl", "ship.mdlx"));
+	ASSERT_TRUE(glob_match("*.pck", "00001.pck"));
+	ASSERT_TRUE(glob_match("*.pck", ".pck"));
+	ASSERT_FALSE(glob_match("*.pck", "00001.xml"));
+	ASSERT_TRUE(glob_match("*", ""));
+	ASSERT_TRUE(glob_match("a*b*c", "aXbYbZc"));
+	ASSERT_FALSE(glob_match("a*b*c", "aXbYbZ"));
+	ASSERT_TRUE(glob_match("*ab*", "aaab"));
+	ASSERT_TRUE(glob_match("x?z", "xyz"));
+	ASSERT_FALSE(glob_match("x?z", "xz"));
+	ASSERT_TRUE(glob_match("**", "anything"));
+}
+
+TEST(path_pattern, glob_match_sets) {
+	ASSERT_TRUE(glob_match("[abc].txt", "b.txt"));
+	ASSERT_FALSE(glob_match("[abc].txt", "d.txt"));
+	ASSERT_TRUE(glob_match("file[0-9]", "file7"));
+	ASSERT_FALSE(glob_match("file[0-9]", "filex"));
+	ASSERT_TRUE(glob_match("file[!0-9]", "filex"));
+	ASSERT_TRUE(glob_match("[]]", "]"));
+	// An unclosed bracket is just a bracket
+	ASSERT_TRUE(glob_match("a[b", "a[b"));
+
+	ASSERT_TRUE(has_wildcards("*.pck"));
+	ASSERT_TRUE(has_wildcards("file[0-9]"));
+	ASSERT_FALSE(has_wildcards("types"));
+}
+
+TEST(path_pattern, regex_literal_prefix) {
+	ASSERT_EQ("types/", regex_literal_prefix("types/.*\\.pck"));
+	ASSERT_EQ("types/", regex_literal_prefix("^types/[0-9]+"));
+	ASSERT_EQ("a.b/c", regex_literal_prefix("a\\.b/c\\d"));
+	// The character before a quantifier might not be there at all
+	ASSERT_EQ("model", regex_literal_prefix("models?/.*"));
+	ASSERT_EQ("abcd", regex_literal_prefix("abcd+"));
+	ASSERT_EQ("", regex_literal_prefix("models/.*|sounds/.*"));
+	ASSERT_EQ("", regex_literal_prefix(".*"));
+}
@@ -1,5 +1,7 @@
 #include "pck.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstring>
 #include <iostream>
 #include <zlib.h>
@@ -11,6 +13,16 @@ constexpr uint8_t GZIP_MAGIC2 = 0x8B;
 // Buffer size for compression/decompression
 constexpr size_t CHUNK_SIZE = 16384; // 16 KB
 
+// zlib counts its input in 32 bits, so anything bigger is handed over a piece at a time.
+// Points zs at the next piece of data and moves data and size past it.
+static void feed(z_stream& zs, const uint8_t*& data, size_t& size) {
+	uInt len = (uInt)std::min<size_t>(size, UINT_MAX);
+	zs.next_in = const_cast<uint8_t*>(data);
+	zs.avail_in = len;
+	data += len;
+	size -= len;
+}
+
 bool is_compressed(const uint8_t* data, size_t size) {
 	if (size < 2) {
 		return false;
@@ -33,14 +45,17 @@ std::vector<uint8_t> unpack(const std::vector<uint8_t>& data) {
 		return {};
 	}
 
-	zs.next_in = const_cast<uint8_t*>(data.data());
-	zs.avail_in = data.size();
+	const uint8_t* input = data.data();
+	size_t input_left = data.size();
 
 	std::vector<uint8_t> output;
 	std::vector<uint8_t> temp_buffer(CHUNK_SIZE);
 
 	int ret;
 	do {
+		if (zs.avail_in == 0) {
+			feed(zs, input, input_left);
+		}
 		zs.next_out = temp_buffer.data();
 		zs.avail_out = temp_buffer.size();
 
@@ -61,6 +76,67 @@ std::vector<uint8_t> unpack(const std::vector<uint8_t>& data) {
 	return output;
 }
 
+unpack_stream::unpack_stream(sink out) : m_out(std::move(out)), m_zs(std::make_unique<z_stream>()) {
+	memset(m_zs.get(), 0, sizeof(z_stream));
+
+	// windowBits = 15 + 16 tells zlib to decode gzip format (automatic header handling)
+	if (inflateInit2(m_zs.get(), 15 + 16) != Z_OK) {
+		std::cerr << "Failed to initialize zlib for decompression\n";
+		m_zs.reset();
+		return;
+	}
+	m_buffer.resize(CHUNK_SIZE);
+	m_ok = true;
+}
+
+unpack_stream::~unpack_stream() {
+	if (m_zs) {
+		inflateEnd(m_zs.get());
+	}
+}
+
+bool unpack_stream::write(const uint8_t* data, size_t size) {
+	if (!m_ok || m_done) {
+		return m_ok;
+	}
+
+	// Keep going while there is input left, or while zlib filled the whole output buffer and may have more
+	do {
+		if (m_zs->avail_in == 0) {
+			feed(*m_zs, data, size);
+		}
+		m_zs->next_out = m_buffer.data();
+		m_zs->avail_out = m_buffer.size();
+
+		int ret = inflate(m_zs.get(), Z_NO_FLUSH);
+		if (ret == Z_BUF_ERROR) {
+			break; // No progress possible until there is more input
+		}
+		if (ret != Z_OK && ret != Z_STREAM_END) {
+			std::cerr << "Decompression failed with error code: " << ret << "\n";
+			m_ok = false;
+			return false;
+		}
+
+		size_t bytes_written = m_buffer.size() - m_zs->avail_out;
+		if (bytes_written > 0 && !m_out(m_buffer.data(), bytes_written)) {
+			m_ok = false;
+			return false;
+		}
+
+		if (ret == Z_STREAM_END) {
+			m_done = true;
+			break;
+		}
+	} while (m_zs->avail_in > 0 || size > 0 || m_zs->avail_out == 0);
+
+	return true;
+}
+
+bool unpack_stream::finish() const {
+	return m_ok && m_done;
+}
+
 std::vector<uint8_t> pack(const std::vector<uint8_t>& data) {
 	if (data.empty()) {
 		return {}; // Cannot compress empty data
@@ -78,18 +154,22 @@ std::vector<uint8_t> pack(const std::vector<uint8_t>& data) {
 		return {};
 	}
 
-	zs.next_in = const_cast<uint8_t*>(data.data());
-	zs.avail_in = data.size();
+	const uint8_t* input = data.data();
+	size_t input_left = data.size();
 
 	std::vector<uint8_t> output;
 	std::vector<uint8_t> temp_buffer(CHUNK_SIZE);
 
 	int ret;
 	do {
+		if (zs.avail_in == 0) {
+			feed(zs, input, input_left);
+		}
 		zs.next_out = temp_buffer.data();
 		zs.avail_out = temp_buffer.size();
 
-		ret = deflate(&zs, Z_FINISH);
+		// Only finish once the last piece of the input has been handed over
+		ret = deflate(&zs, input_left > 0 ? Z_NO_FLUSH : Z_FINISH);
 
 		if (ret != Z_OK && ret != Z_STREAM_END) {
 			std::cerr << "Compression failed with error code: " << ret << "\n";
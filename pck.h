@@ -1,9 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+struct z_stream_s;
+
 /**
  * PCK compression support for X3: Terran Conflict and later.
  *
@@ -29,6 +33,45 @@ bool is_compressed(const uint8_t* data, size_t size);
  */
 std::vector<uint8_t> unpack(const std::vector<uint8_t>& data);
 
+/**
+ * Incremental gzip decompressor, for data that arrives a piece at a time.
+ *
+ * Decompressed output is handed to the sink in blocks of a fixed size as it is
+ * produced, so memory use does not depend on the size of the data.
+ */
+class unpack_stream {
+public:
+	/** Receives decompressed data; returns false to abort decompression */
+	using sink = std::function<bool(const uint8_t* data, size_t size)>;
+
+	explicit unpack_stream(sink out);
+	~unpack_stream();
+
+	unpack_stream(const unpack_stream&) = delete;
+	unpack_stream& operator=(const unpack_stream&) = delete;
+
+	/**
+	 * Decompress the next piece of gzip data. Anything after the end of the gzip stream is ignored.
+	 *
+	 * @return false if the data is not valid gzip or the sink failed
+	 */
+	bool write(const uint8_t* data, size_t size);
+
+	/**
+	 * Check that the whole gzip stream has been seen.
+	 *
+	 * @return true if decompression completed without errors
+	 */
+	bool finish() const;
+
+private:
+	sink m_out;
+	std::unique_ptr<z_stream_s> m_zs;
+	std::vector<uint8_t> m_buffer;
+	bool m_ok = false;
+	bool m_done = false;
+};
+
 /**
  * Compress data to gzip format.
  *
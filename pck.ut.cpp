@@ -160,3 +160,76 @@ TEST(pck, compressed_has_gzip_header) {
 	EXPECT_EQ(compressed[1], 0x8B);
 	EXPECT_TRUE(is_compressed(compressed.data(), compressed.size()));
 }
+
+// Test incremental decompression
+TEST(pck, unpack_stream_byte_at_a_time) {
+	std::vector<uint8_t> original(100000);
+	for (size_t i = 0; i < original.size(); i++) {
+		original[i] = (i * 31) % 253;
+	}
+	auto compressed = pack(original);
+	ASSERT_FALSE(compressed.empty());
+
+	std::vector<uint8_t> output;
+	size_t largest_block = 0;
+	unpack_stream stream([&](const uint8_t* data, size_t size) {
+		output.insert(output.end(), data, data + size);
+		largest_block = std::max(largest_block, size);
+		return true;
+	});
+	for (uint8_t byte : compressed) {
+		ASSERT_TRUE(stream.write(&byte, 1));
+	}
+
+	EXPECT_TRUE(stream.finish());
+	EXPECT_EQ(original, output);
+	// Output arrives in bounded blocks, not all at once
+	EXPECT_LT(largest_block, original.size());
+}
+
+TEST(pck, unpack_stream_highly_compressible) {
+	// Tiny input that expands to many output blocks in a single write
+	std::vector<uint8_t> original(1024 * 1024, 'A');
+	auto compressed = pack(original);
+
+	size_t total = 0;
+	unpack_stream stream([&](const uint8_t* data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			if (data[i] != 'A') {
+				return false;
+			}
+		}
+		total += size;
+		return true;
+	});
+	ASSERT_TRUE(stream.write(compressed.data(), compressed.size()));
+	EXPECT_TRUE(stream.finish());
+	EXPECT_EQ(original.size(), total);
+}
+
+TEST(pck, unpack_stream_truncated) {
+	std::vector<uint8_t> original(5000, 'x');
+	auto compressed = pack(original);
+	compressed.resize(compressed.size() / 2);
+
+	unpack_stream stream([](const uint8_t*, size_t) { return true; });
+	stream.write(compressed.data(), compressed.size());
+	EXPECT_FALSE(stream.finish());
+}
+
+TEST(pck, unpack_stream_invalid) {
+	uint8_t garbage[] = {0x1F, 0x8B, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+	unpack_stream stream([](const uint8_t*, size_t) { return true; });
+	EXPECT_FALSE(stream.write(garbage, sizeof(garbage)));
+	EXPECT_FALSE(stream.finish());
+}
+
+TEST(pck, unpack_stream_sink_failure) {
+	std::vector<uint8_t> original(5000, 'x');
+	auto compressed = pack(original);
+
+	unpack_stream stream([](const uint8_t*, size_t) { return false; });
+	EXPECT_FALSE(stream.write(compressed.data(), compressed.size()));
+	EXPECT_FALSE(stream.finish());
+}
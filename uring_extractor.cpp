@@ -0,0 +1,367 @@
+#include "uring_extractor.h"
+
+#include "cipher.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// What each completion is for goes in the low bits of its user data, with a slot or file index above
+enum op_type : uint64_t {
+	OP_READ,
+	OP_OPEN,
+	OP_FALLOCATE,
+	OP_WRITE,
+	OP_SYNC,
+	OP_FADVISE,
+	OP_CLOSE,
+};
+static const unsigned OP_BITS = 3;
+
+static io_uring_sqe make_sqe(uint8_t opcode, int fd, const void* addr, uint32_t len, uint64_t offset, op_type op,
+                             uint64_t index) {
+	io_uring_sqe sqe;
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = opcode;
+	sqe.fd = fd;
+	sqe.addr = (uint64_t)addr;
+	sqe.len = len;
+	sqe.off = offset;
+	sqe.user_data = index << OP_BITS | op;
+	return sqe;
+}
+
+uring_extractor::uring_extractor(output_dir& out, uint64_t slot_size)
+	: m_out(out), m_slot_size(std::min(slot_size, SLOT_SIZE)), m_slots(SLOTS) {
+	if (!m_ring.init(QUEUE_DEPTH)) {
+		return;
+	}
+
+	m_buffers = std::make_unique<uint8_t[]>(SLOTS * m_slot_size);
+	std::vector<iovec> iovecs(SLOTS);
+	for (unsigned i = 0; i < SLOTS; ++i) {
+		m_slots[i].buffer = m_buffers.get() + i * m_slot_size;
+		iovecs[i] = {m_slots[i].buffer, m_slot_size};
+	}
+	// Pinning the buffers can fail under a low memlock limit; plain reads and writes still work
+	m_fixed_buffers = m_ring.register_buffers(iovecs);
+}
+
+bool uring_extractor::add(const datafile& df, std::span<const datafile::index_entry* const> run) {
+	if (m_failed) {
+		return false;
+	}
+
+	uint64_t start = run.front()->offset;
+	uint64_t length = run.back()->offset + run.back()->size - start;
+	int fd = df.m_datreader.fd();
+	if (!is_open() || length > m_slot_size || df.is_datfile_mapped() || fd < 0) {
+		// Too big for a buffer, or nothing to gain from the ring; extract_run reports any errors
+		return df.extract_run(run, m_out, m_buffer);
+	}
+
+	unsigned idx = SLOTS;
+	for (;;) {
+		for (unsigned i = 0; i < SLOTS && idx == SLOTS; ++i) {
+			if (!m_slots[i].busy) {
+				idx = i;
+			}
+		}
+		if (idx != SLOTS) {
+			break;
+		}
+		if (!pump(true)) {
+			return false;
+		}
+	}
+
+	slot& s = m_slots[idx];
+	s.df = &df;
+	s.run = run;
+	s.fd = fd;
+	s.start = start;
+	s.length = length;
+	s.read = 0;
+	s.files_left = 0;
+	s.busy = true;
+	if (length == 0) {
+		read_done(idx);
+	} else {
+		queue_read(idx);
+	}
+
+	return pump(false) && !m_failed;
+}
+
+bool uring_extractor::finish() {
+	while (m_in_flight > 0 || !m_pending.empty()) {
+		if (!pump(true)) {
+			return false;
+		}
+	}
+	return !m_failed;
+}
+
+bool uring_extractor::pump(bool wait) {
+	// Keep no more in flight than there is room for completions
+	while (!m_pending.empty() && m_in_flight < m_ring.completion_entries() && m_ring.queue(m_pending.front())) {
+		m_pending.pop_front();
+		++m_in_flight;
+	}
+
+	if (!m_ring.submit(wait && m_in_flight > 0 ? 1 : 0)) {
+		std::cerr << "Could not submit I/O to the kernel: " << strerror(errno) << std::endl;
+		m_failed = true;
+		return false;
+	}
+
+	io_uring_cqe cqe;
+	while (m_ring.pop(cqe)) {
+		--m_in_flight;
+		complete(cqe.user_data, cqe.res);
+	}
+	// Open as many files as were closed
+	queue_opens();
+	return true;
+}
+
+void uring_extractor::queue_read(unsigned slot_idx) {
+	slot& s = m_slots[slot_idx];
+	io_uring_sqe sqe = make_sqe(m_fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ,
+	                            s.fd,
+	                            s.buffer + s.read,
+	                            s.length - s.read,
+	                            s.start + s.read,
+	                            OP_READ,
+	                            slot_idx);
+	sqe.buf_index = slot_idx;
+	m_pending.push_back(sqe);
+}
+
+void uring_extractor::read_done(unsigned slot_idx) {
+	slot& s = m_slots[slot_idx];
+	if (s.df->m_drop_cache) {
+		s.df->m_datreader.dont_need(s.start, s.length);
+	}
+	dat_cipher(s.buffer, s.buffer, s.length);
+
+	for (const datafile::index_entry* entry : s.run) {
+		const uint8_t* data = s.buffer + (entry->offset - s.start);
+		if (s.df->needs_unpack(*entry)) {
+			// Inflating gains nothing from the ring, so these are written out the ordinary way
+			if (!s.df->write_data(*entry, m_out, entry->relpath, data, entry->size)) {
+				m_failed = true;
+			}
+			continue;
+		}
+
+		size_t idx;
+		if (m_free_files.empty()) {
+			idx = m_files.size();
+			m_files.emplace_back();
+		} else {
+			idx = m_free_files.back();
+			m_free_files.pop_back();
+		}
+		file& f = m_files[idx];
+		f.slot = slot_idx;
+		f.entry = entry;
+		f.fd = -1;
+		f.written = 0;
+		f.failed = false;
+		++s.files_left;
+		m_waiting_files.push_back(idx);
+	}
+	queue_opens();
+
+	if (s.files_left == 0) {
+		s.busy = false;
+	}
+}
+
+void uring_extractor::queue_opens() {
+	while (!m_waiting_files.empty() && m_open_files < m_max_open_files) {
+		size_t idx = m_waiting_files.front();
+		m_waiting_files.pop_front();
+		++m_open_files;
+
+		file& f = m_files[idx];
+		f.dir = m_out.parent_dir(f.entry->relpath, f.name);
+		if (!f.dir) {
+			m_failed = true;
+			file_done(idx);
+			continue;
+		}
+		io_uring_sqe sqe = make_sqe(IORING_OP_OPENAT, f.dir->fd(), f.name.c_str(), 0666, 0, OP_OPEN, idx);
+		sqe.open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+		m_pending.push_back(sqe);
+	}
+}
+
+void uring_extractor::open_failed(size_t file_idx, int error) {
+	file& f = m_files[file_idx];
+	if (error != EMFILE && error != ENFILE) {
+		std::cerr << "Could not open output file " << m_out.root() / f.entry->relpath
+		          << " for writing: " << strerror(error) << std::endl;
+		m_failed = true;
+		file_done(file_idx);
+		return;
+	}
+
+	// Out of descriptors: keep no more files open than the ones that made it
+	m_max_open_files = std::max(1u, m_open_files - 1);
+	if (m_open_files > 1) {
+		// Try again once one of the others is closed
+		--m_open_files;
+		m_waiting_files.push_front(file_idx);
+		return;
+	}
+
+	// Nothing else holds a descriptor, so let output_dir give back its directories and try itself
+	slot& s = m_slots[f.slot];
+	if (!s.df->write_data(*f.entry, m_out, f.entry->relpath, s.buffer + (f.entry->offset - s.start), f.entry->size)) {
+		m_failed = true;
+	}
+	file_done(file_idx);
+}
+
+void uring_extractor::queue_write(size_t file_idx) {
+	file& f = m_files[file_idx];
+	slot& s = m_slots[f.slot];
+	const uint8_t* data = s.buffer + (f.entry->offset - s.start) + f.written;
+	io_uring_sqe sqe = make_sqe(m_fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+	                            f.fd,
+	                            data,
+	                            f.entry->size - f.written,
+	                            f.written,
+	                            OP_WRITE,
+	                            file_idx);
+	sqe.buf_index = f.slot;
+	m_pending.push_back(sqe);
+}
+
+void uring_extractor::file_written(size_t file_idx) {
+	file& f = m_files[file_idx];
+	if (m_slots[f.slot].df->m_drop_cache) {
+		// Dirty pages can't be dropped, so they have to reach the disk first
+		io_uring_sqe sqe = make_sqe(IORING_OP_SYNC_FILE_RANGE, f.fd, nullptr, 0, 0, OP_SYNC, file_idx);
+		sqe.sync_range_flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER;
+		m_pending.push_back(sqe);
+	} else {
+		m_pending.push_back(make_sqe(IORING_OP_CLOSE, f.fd, nullptr, 0, 0, OP_CLOSE, file_idx));
+	}
+}
+
+void uring_extractor::file_done(size_t file_idx) {
+	slot& s = m_slots[m_files[file_idx].slot];
+	if (--s.files_left == 0) {
+		s.busy = false;
+	}
+	m_free_files.push_back(file_idx);
+	// Its descriptor is free for the next file; see queue_opens()
+	--m_open_files;
+}
+
+void uring_extractor::discard(size_t file_idx) {
+	// Don't leave a truncated or half-written file behind in place of the real one
+	const file& f = m_files[file_idx];
+	if (!m_out.remove(f.entry->relpath)) {
+		std::cerr << "Could not remove incomplete output file " << m_out.root() / f.entry->relpath << std::endl;
+	}
+}
+
+void uring_extractor::complete(uint64_t user_data, int result) {
+	op_type op = (op_type)(user_data & ((1 << OP_BITS) - 1));
+	uint64_t index = user_data >> OP_BITS;
+
+	if (op == OP_READ) {
+		slot& s = m_slots[index];
+		if (result <= 0) {
+			std::cerr << "I/O error while reading " << s.run.front()->relpath << " from " << s.df->get_datfile_name()
+			          << ": " << (result < 0 ? strerror(-result) : "file too short") << std::endl;
+			m_failed = true;
+			s.busy = false;
+			return;
+		}
+		s.read += result;
+		if (s.read < s.length) {
+			queue_read(index);
+		} else {
+			read_done(index);
+		}
+		return;
+	}
+
+	file& f = m_files[index];
+	auto path = [&] { return m_out.root() / f.entry->relpath; };
+	switch (op) {
+	case OP_OPEN:
+		// The directory is only needed until the file is open
+		f.dir.reset();
+		if (result < 0) {
+			open_failed(index, -result);
+			return;
+		}
+		f.fd = result;
+		if (f.entry->size == 0) {
+			file_written(index);
+		} else if (f.entry->size > datafile::SMALL_ENTRY_SIZE) {
+			// Lay the file out in one go; the length goes in addr
+			m_pending.push_back(
+				make_sqe(IORING_OP_FALLOCATE, f.fd, (const void*)f.entry->size, 0, 0, OP_FALLOCATE, index));
+		} else {
+			queue_write(index);
+		}
+		break;
+	case OP_FALLOCATE:
+		// Only a hint, so it doesn't matter if the filesystem can't do it
+		queue_write(index);
+		break;
+	case OP_WRITE:
+		if (result <= 0) {
+			std::cerr << "Error when writing " << path() << ": " << (result < 0 ? strerror(-result) : "nothing written")
+			          << std::endl;
+			m_failed = true;
+			::close(f.fd);
+			discard(index);
+			file_done(index);
+			return;
+		}
+		f.written += result;
+		if (f.written < f.entry->size) {
+			queue_write(index);
+		} else {
+			file_written(index);
+		}
+		break;
+	case OP_SYNC: {
+		if (result < 0) {
+			std::cerr << "Error when writing " << path() << ": " << strerror(-result) << std::endl;
+			m_failed = true;
+			f.failed = true;
+		}
+		io_uring_sqe sqe = make_sqe(IORING_OP_FADVISE, f.fd, nullptr, 0, 0, OP_FADVISE, index);
+		sqe.fadvise_advice = POSIX_FADV_DONTNEED;
+		m_pending.push_back(sqe);
+	} break;
+	case OP_FADVISE:
+		m_pending.push_back(make_sqe(IORING_OP_CLOSE, f.fd, nullptr, 0, 0, OP_CLOSE, index));
+		break;
+	case OP_CLOSE:
+		if (result < 0) {
+			std::cerr << "Error when writing " << path() << ": " << strerror(-result) << std::endl;
+			m_failed = true;
+			f.failed = true;
+		}
+		if (f.failed) {
+			discard(index);
+		}
+		file_done(index);
+		break;
+	default:
+		break;
+	}
+}
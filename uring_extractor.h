@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "datafile.h"
+#include "io_ring.h"
+#include "output_dir.h"
+
+/**
+ * Extracts runs of entries (see datafile::coalesce()) through io_uring.
+ *
+ * The reads from the .dat files and the opens, writes and closes of the output files (and
+ * their preallocation and page cache hints) are all queued on one ring and handed to the
+ * kernel in batches, so that many of them are in flight at once instead of the worker
+ * waiting on one system call at a time. Runs are read into a few buffers registered with
+ * the kernel, and written out straight from them. Only MAX_OPEN_FILES output files are
+ * open at once, fewer if the process runs out of descriptors.
+ *
+ * Use one per thread. If the kernel doesn't offer io_uring, is_open() is false, and runs
+ * should be extracted with datafile::extract_run() instead.
+ */
+class uring_extractor {
+public:
+	/**
+	 * Set up a ring that writes under out, with buffers of slot_size bytes (at most SLOT_SIZE).
+	 * Runs longer than that are extracted the ordinary way.
+	 */
+	uring_extractor(output_dir& out, uint64_t slot_size = SLOT_SIZE);
+	~uring_extractor() { finish(); }
+
+	uring_extractor(const uring_extractor&) = delete;
+	uring_extractor& operator=(const uring_extractor&) = delete;
+
+	bool is_open() const { return m_ring.is_open(); }
+
+	/**
+	 * Start extracting a run of entries from df. This returns once the run is queued, which
+	 * can mean waiting for earlier runs to finish. Returns false if anything has failed so far.
+	 */
+	bool add(const datafile& df, std::span<const datafile::index_entry* const> run);
+
+	/**
+	 * Wait for everything queued to be written. Returns false if anything failed.
+	 */
+	bool finish();
+
+	/** How many runs can be in flight at once; each one gets a buffer of its own */
+	static constexpr unsigned SLOTS = 4;
+	/** Largest buffer a slot can have */
+	static constexpr uint64_t SLOT_SIZE = datafile::COALESCE_SIZE;
+	/** Size of the submission queue */
+	static constexpr unsigned QUEUE_DEPTH = 128;
+	/** Most output files open (or being opened) through the ring at once */
+	static constexpr unsigned MAX_OPEN_FILES = QUEUE_DEPTH;
+
+private:
+	// A buffer and the run being read into it
+	struct slot {
+		uint8_t* buffer = nullptr;
+		const datafile* df = nullptr;
+		std::span<const datafile::index_entry* const> run;
+		int fd = -1;
+		uint64_t start = 0; // Where the run starts in the .dat file
+		uint64_t length = 0;
+		uint64_t read = 0;
+		size_t files_left = 0; // Files from the run still being written
+		bool busy = false;
+	};
+
+	// An output file on its way through open, write and close
+	struct file {
+		unsigned slot = 0;
+		const datafile::index_entry* entry = nullptr;
+		std::string name; // Relative to dir
+		std::shared_ptr<dir_handle> dir;
+		int fd = -1;
+		uint64_t written = 0;
+		bool failed = false; // Deleted once closed, since it wasn't written in full
+	};
+
+	bool pump(bool wait);
+	void complete(uint64_t user_data, int result);
+	void queue_read(unsigned slot_idx);
+	void read_done(unsigned slot_idx);
+	void queue_opens();
+	void open_failed(size_t file_idx, int error);
+	void queue_write(size_t file_idx);
+	void file_written(size_t file_idx);
+	void file_done(size_t file_idx);
+	void discard(size_t file_idx);
+
+	output_dir& m_out;
+	std::unique_ptr<uint8_t[]> m_buffers;
+	uint64_t m_slot_size;
+	std::vector<slot> m_slots;
+	// Files being written; a deque so the names handed to openat stay put
+	std::deque<file> m_files;
+	std::vector<size_t> m_free_files;
+	// Files waiting for their turn to be opened, so only so many descriptors are used at once
+	std::deque<size_t> m_waiting_files;
+	unsigned m_open_files = 0;
+	// Lowered when the process runs out of descriptors
+	unsigned m_max_open_files = MAX_OPEN_FILES;
+	// Operations waiting for room in the ring
+	std::deque<io_uring_sqe> m_pending;
+	unsigned m_in_flight = 0;
+	bool m_fixed_buffers = false;
+	bool m_failed = false;
+	// For runs that are extracted the ordinary way
+	std::vector<uint8_t> m_buffer;
+	// Last, so it's closed before the buffers it reads into go away
+	io_ring m_ring;
+};
@@ -0,0 +1,181 @@
+#include "uring_extractor.h"
+#include "datadir.h"
+#include "test_utils.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+static const std::string TEST_DIR = "test_uring_extractor";
+
+class uring_extractor_tests : public ::testing::Test {
+protected:
+	void SetUp() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+		std::filesystem::create_directories(TEST_DIR);
+	}
+
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove_all(TEST_DIR, ec);
+	}
+};
+
+TEST_F(uring_extractor_tests, extract_archive) {
+	datafile df("test_artifacts/test.cat");
+	df.use_io_uring();
+
+	// Whether or not the kernel has io_uring, the result is the same
+	for (unsigned jobs : {1u, 3u}) {
+		std::string extract_dir = TEST_DIR + "/out" + std::to_string(jobs);
+		ASSERT_TRUE(df.extract(extract_dir, jobs));
+		for (const auto& name : df.get_file_list()) {
+			auto expected = df.extract_one_file_to_buffer(name, true);
+			ASSERT_EQ(std::string(expected.begin(), expected.end()), test_utils::read_file(extract_dir + "/" + name))
+				<< name;
+		}
+	}
+}
+
+TEST_F(uring_extractor_tests, extract_runs) {
+	output_dir out(TEST_DIR + "/runs");
+	uring_extractor ring(out);
+	if (!ring.is_open()) {
+		GTEST_SKIP() << "io_uring is not available here";
+	}
+
+	datafile df("test_artifacts/test.cat");
+	std::vector<const datafile::index_entry*> entries;
+	for (const auto& entry : df.get_entries()) {
+		entries.push_back(&entry);
+	}
+	// More runs than buffers, so some have to wait for others to be written
+	for (auto [first, last] : datafile::coalesce(entries)) {
+		for (size_t i = first; i < last; ++i) {
+			ASSERT_TRUE(ring.add(df, std::span(entries).subspan(i, 1)));
+		}
+	}
+	ASSERT_TRUE(ring.finish());
+
+	for (const auto* entry : entries) {
+		auto expected = df.extract_entry_to_buffer(*entry);
+		ASSERT_EQ(std::string(expected.begin(), expected.end()),
+		          test_utils::read_file(TEST_DIR + "/runs/" + std::string(entry->relpath)));
+	}
+}
+
+TEST_F(uring_extractor_tests, drop_cache) {
+	std::filesystem::copy("test_artifacts/test.cat", TEST_DIR + "/drop.cat");
+	std::filesystem::copy("test_artifacts/test.dat", TEST_DIR + "/drop.dat");
+
+	datafile df(TEST_DIR + "/drop.cat");
+	df.use_io_uring();
+	df.drop_cache_after_extract();
+	ASSERT_TRUE(df.extract(TEST_DIR + "/out", 2));
+	for (const auto& name : df.get_file_list()) {
+		auto expected = df.extract_one_file_to_buffer(name, true);
+		ASSERT_EQ(std::string(expected.begin(), expected.end()), test_utils::read_file(TEST_DIR + "/out/" + name))
+			<< name;
+	}
+}
+
+TEST_F(uring_extractor_tests, read_error) {
+	std::filesystem::copy("test_artifacts/test.cat", TEST_DIR + "/short.cat");
+	std::filesystem::copy("test_artifacts/test.dat", TEST_DIR + "/short.dat");
+	std::filesystem::resize_file(TEST_DIR + "/short.dat", 10);
+
+	datafile df(TEST_DIR + "/short.cat");
+	df.use_io_uring();
+	ASSERT_FALSE(df.extract(TEST_DIR + "/out"));
+}
+
+TEST_F(uring_extractor_tests, write_error) {
+	output_dir out(TEST_DIR + "/full");
+	uring_extractor ring(out);
+	if (!ring.is_open()) {
+		GTEST_SKIP() << "io_uring is not available here";
+	}
+	datafile df("test_artifacts/test.cat");
+	const datafile::index_entry* entry = df.find_entry("testdir/testfile.ext", true);
+	ASSERT_TRUE(entry);
+
+	// Every write to /dev/full fails, and the file that was there doesn't stay behind
+	std::filesystem::path target = TEST_DIR + "/full/testdir/testfile.ext";
+	std::filesystem::create_directories(target.parent_path());
+	std::error_code ec;
+	std::filesystem::create_symlink("/dev/full", target, ec);
+	if (ec) {
+		GTEST_SKIP() << "Cannot link to /dev/full here: " << ec.message();
+	}
+
+	ASSERT_TRUE(ring.add(df, std::span(&entry, 1)));
+	ASSERT_FALSE(ring.finish());
+	ASSERT_FALSE(std::filesystem::exists(std::filesystem::symlink_status(target)));
+}
+
+TEST_F(uring_extractor_tests, out_of_descriptors) {
+	// Many more small files than the descriptors left, spread over a few directories
+	std::string src = TEST_DIR + "/many_src";
+	for (int i = 0; i < 600; ++i) {
+		std::filesystem::path dir = std::filesystem::path(src) / ("d" + std::to_string(i % 3));
+		std::filesystem::create_directories(dir);
+		std::filesystem::path name = dir / ("f" + std::to_string(i));
+		std::ofstream(name) << std::string(50, 'a' + i % 26);
+	}
+	datafile builder;
+	ASSERT_TRUE(builder.build(src, TEST_DIR + "/many.cat"));
+
+	datafile df(TEST_DIR + "/many.cat");
+	output_dir out(TEST_DIR + "/many_out");
+	uring_extractor ring(out);
+	if (!ring.is_open()) {
+		GTEST_SKIP() << "io_uring is not available here";
+	}
+	std::vector<const datafile::index_entry*> entries;
+	for (const auto& entry : df.get_entries()) {
+		entries.push_back(&entry);
+	}
+	// Open the .dat file before the limit goes down
+	ASSERT_FALSE(df.extract_entry_to_buffer(*entries[0]).empty());
+
+	int lowest = dup(0);
+	ASSERT_GE(lowest, 0);
+	close(lowest);
+	rlimit old_limit;
+	ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &old_limit));
+	rlimit limit = old_limit;
+	limit.rlim_cur = lowest + 8;
+	ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+
+	bool extracted = true;
+	for (auto [first, last] : datafile::coalesce(entries)) {
+		extracted = extracted && ring.add(df, std::span(entries).subspan(first, last - first));
+	}
+	extracted = ring.finish() && extracted;
+	setrlimit(RLIMIT_NOFILE, &old_limit);
+
+	ASSERT_TRUE(extracted);
+	for (const auto* entry : entries) {
+		auto expected = df.extract_entry_to_buffer(*entry);
+		ASSERT_EQ(std::string(expected.begin(), expected.end()),
+		          test_utils::read_file(TEST_DIR + "/many_out/" + std::string(entry->relpath)))
+			<< entry->relpath;
+	}
+}
+
+TEST_F(uring_extractor_tests, extract_all) {
+	datadir dd("test_artifacts/composite");
+	dd.use_io_uring();
+	ASSERT_TRUE(dd.extract(TEST_DIR, 2));
+
+	ASSERT_EQ("Model v10 FINAL\n", test_utils::read_file(TEST_DIR + "/models/ship.mdl"));
+	ASSERT_EQ("Model v2 UPDATED\n", test_utils::read_file(TEST_DIR + "/models/station.mdl"));
+	ASSERT_EQ("Script v1\n", test_utils::read_file(TEST_DIR + "/scripts/main.lua"));
+	ASSERT_EQ("Sound v2 NEW\n", test_utils::read_file(TEST_DIR + "/sounds/weapons.wav"));
+}